@@ -0,0 +1,217 @@
+// CGICache.cpp
+#include "CGICache.hpp"
+#include "HTTPRequest.hpp"
+#include "HTTPResponse.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+CGICache::CGICache(size_t capacity, unsigned long validMs, unsigned long staleMs)
+    : _capacity(capacity), _validMs(validMs), _staleMs(staleMs), _used(0) {}
+
+CGICache::~CGICache() {}
+
+bool CGICache::accepts(const HTTPRequest& request) {
+    return request.getMethod() == "GET" && request.getStrHeader("Authorization").empty();
+}
+
+std::string CGICache::makeKey(const HTTPRequest& request) {
+    return request.getMethod() + " " + request.getPath() + "?" + request.getQueryString();
+}
+
+size_t CGICache::getCapacity() const { return _capacity; }
+
+// Headers already set on the response, such as the session cookie, are kept
+void CGICache::fill(const CachedResponse& cached, HTTPResponse& response, unsigned long now) {
+    response.setStatusCode(cached.statusCode);
+    if (!cached.reasonPhrase.empty())
+        response.setReasonPhrase(cached.reasonPhrase);
+    for (std::map<std::string, std::string>::const_iterator it = cached.headers.begin(); it != cached.headers.end(); ++it)
+        response.setHeader(it->first, it->second);
+    response.setHeader("Age", to_string((now - cached.storedAt) / 1000));
+    response.setBody(cached.body);
+}
+
+size_t CGICache::cost(const CachedResponse& entry) {
+    size_t size = entry.key.size() + entry.body.size();
+    for (std::map<std::string, std::string>::const_iterator it = entry.headers.begin(); it != entry.headers.end(); ++it)
+        size += it->first.size() + it->second.size();
+    return size;
+}
+
+void CGICache::erase(EntryList::iterator it) {
+    _used -= cost(*it);
+    _index.erase(it->key);
+    _entries.erase(it);
+}
+
+CGICache::Status CGICache::lookup(const std::string& key, unsigned long now, const CachedResponse*& entry) {
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(key);
+    bool running = _flights.count(key) != 0;
+    if (found != _index.end() && now >= found->second->staleUntil) {
+        erase(found->second);
+        found = _index.end();
+    }
+    if (found != _index.end()) {
+        EntryList::iterator it = found->second;
+        _entries.splice(_entries.begin(), _entries, it);
+        entry = &*it;
+        if (it->pass)
+            return CACHE_PASS;
+        if (now < it->freshUntil)
+            return CACHE_HIT;
+        if (running)
+            return CACHE_STALE;
+    } else if (running) {
+        return CACHE_BUSY;
+    }
+    _flights[key];
+    return CACHE_MISS;
+}
+
+// Seconds of a "name=N" directive, -1 if it is not this one
+static long directiveSeconds(const std::string& directive, const std::string& name) {
+    if (directive.compare(0, name.size() + 1, name + "=") != 0)
+        return -1;
+    std::string value = directive.substr(name.size() + 1);
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+        return -1;
+    return std::strtol(value.c_str(), NULL, 10);
+}
+
+bool CGICache::prepare(const HTTPResponse& response, unsigned long now, CachedResponse& entry) const {
+    if (response.getStatusCode() != 200 || !response.findHeader("Set-Cookie").empty())
+        return false;
+    // The key has no room for the request headers the response depends on
+    std::string vary = response.findHeader("Vary");
+    if ((!vary.empty() && vary != "Accept-Encoding") || !response.findHeader("Content-Encoding").empty())
+        return false;
+
+    long maxAge = -1, sharedMaxAge = -1, stale = -1;
+    bool noCache = false;
+    std::istringstream directives(response.findHeader("Cache-Control"));
+    std::string directive;
+    while (std::getline(directives, directive, ',')) {
+        size_t start = directive.find_first_not_of(" \t");
+        size_t end = directive.find_last_not_of(" \t");
+        if (start == std::string::npos)
+            continue;
+        directive = directive.substr(start, end - start + 1);
+        for (size_t i = 0; i < directive.size(); ++i)
+            directive[i] = std::tolower(directive[i]);
+        if (directive == "no-store" || directive == "private")
+            return false;
+        // Still handed to the requests waiting for it
+        if (directive == "no-cache")
+            noCache = true;
+        long seconds;
+        if ((seconds = directiveSeconds(directive, "max-age")) != -1)
+            maxAge = seconds;
+        else if ((seconds = directiveSeconds(directive, "s-maxage")) != -1)
+            sharedMaxAge = seconds;
+        else if ((seconds = directiveSeconds(directive, "stale-while-revalidate")) != -1)
+            stale = seconds;
+    }
+
+    unsigned long validMs = _validMs;
+    std::string expires = response.findHeader("Expires");
+    time_t expiresAt;
+    if (noCache) {
+        validMs = 0;
+        stale = 0;
+    } else if (sharedMaxAge != -1 || maxAge != -1) {
+        validMs = (sharedMaxAge != -1 ? sharedMaxAge : maxAge) * 1000UL;
+    } else if (!expires.empty()) {
+        // An invalid date means already expired
+        time_t current = time(NULL);
+        validMs = 0;
+        if (parse_http_date(expires, expiresAt) && expiresAt > current)
+            validMs = (expiresAt - current) * 1000UL;
+    }
+
+    entry.statusCode = response.getStatusCode();
+    entry.reasonPhrase = response.getReasonPhrase();
+    entry.headers = response.getHeaders();
+    entry.storedAt = now;
+    entry.freshUntil = now + validMs;
+    entry.staleUntil = entry.freshUntil + (stale != -1 ? stale * 1000UL : _staleMs);
+    entry.pass = false;
+    return true;
+}
+
+void CGICache::store(const CachedResponse& entry) {
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(entry.key);
+    if (found != _index.end())
+        erase(found->second);
+    if (entry.staleUntil <= entry.storedAt || cost(entry) > _capacity)
+        return;
+
+    _entries.push_front(entry);
+    CachedResponse& stored = _entries.front();
+    _index[stored.key] = _entries.begin();
+    _used += cost(stored);
+    if (!stored.pass)
+        Logger::instance().log(DEBUG, "CGI cache: stored " + stored.key + " for "
+                               + to_string(stored.freshUntil - stored.storedAt) + " ms");
+
+    while (_used > _capacity && _entries.size() > 1)
+        erase(--_entries.end());
+}
+
+bool CGICache::join(const std::string& key, int client_fd) {
+    std::map<std::string, std::vector<int> >::iterator flight = _flights.find(key);
+    if (flight == _flights.end())
+        return false;
+    flight->second.push_back(client_fd);
+    _waiters[client_fd] = key;
+    return true;
+}
+
+void CGICache::cancel(int client_fd) {
+    std::map<int, std::string>::iterator waiter = _waiters.find(client_fd);
+    if (waiter == _waiters.end())
+        return;
+    std::vector<int>& waiting = _flights[waiter->second];
+    waiting.erase(std::remove(waiting.begin(), waiting.end(), client_fd), waiting.end());
+    _waiters.erase(waiter);
+}
+
+bool CGICache::isWaiting(int client_fd) const { return _waiters.count(client_fd) != 0; }
+
+void CGICache::finish(const std::string& key, std::vector<int>& waiters) {
+    std::map<std::string, std::vector<int> >::iterator flight = _flights.find(key);
+    if (flight == _flights.end())
+        return;
+    waiters.swap(flight->second);
+    _flights.erase(flight);
+    for (size_t i = 0; i < waiters.size(); ++i)
+        _waiters.erase(waiters[i]);
+}
+
+void CGICache::release(const std::string& key) {
+    std::vector<int> waiters;
+    finish(key, waiters);
+    _released.insert(_released.end(), waiters.begin(), waiters.end());
+}
+
+void CGICache::pass(const std::string& key, unsigned long now) {
+    CachedResponse marker;
+    marker.key = key;
+    marker.statusCode = 0;
+    marker.storedAt = now;
+    marker.freshUntil = now + _validMs;
+    marker.staleUntil = marker.freshUntil;
+    marker.pass = true;
+    store(marker);
+    release(key);
+}
+
+void CGICache::collectReleased(std::set<int>& pending) {
+    pending.insert(_released.begin(), _released.end());
+    _released.clear();
+}
@@ -0,0 +1,92 @@
+// CGICache.hpp
+#ifndef CGICACHE_HPP
+#define CGICACHE_HPP
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+class HTTPRequest;
+class HTTPResponse;
+
+// Output of a CGI script, replayed for identical requests
+struct CachedResponse {
+    std::string key;
+    int statusCode;
+    std::string reasonPhrase;
+    std::map<std::string, std::string> headers;
+    std::string body;
+    unsigned long storedAt;
+    // Served as is until freshUntil, then while a request refreshes it until staleUntil
+    unsigned long freshUntil;
+    unsigned long staleUntil;
+    // The last response could not be shared: requests run the script on their own
+    bool pass;
+};
+
+// LRU cache of CGI responses of a location, keyed by method, path and query
+// and bounded by a byte budget. Lifetimes come from the Cache-Control or
+// Expires headers of the script, validMs otherwise.
+// Only one script runs per key: identical requests arriving meanwhile wait
+// for its response instead of starting their own.
+class CGICache {
+public:
+    enum Status { CACHE_MISS, CACHE_HIT, CACHE_STALE, CACHE_BUSY, CACHE_PASS };
+
+    CGICache(size_t capacity, unsigned long validMs, unsigned long staleMs);
+    ~CGICache();
+
+    // Only GETs without credentials are shared between clients
+    static bool accepts(const HTTPRequest& request);
+    static std::string makeKey(const HTTPRequest& request);
+    // Copies the cached status, headers and body into response
+    static void fill(const CachedResponse& cached, HTTPResponse& response, unsigned long now);
+
+    // CACHE_MISS: the caller runs the script for the key until finish() or
+    // release(). CACHE_STALE: past its freshness, while another request
+    // refreshes it. CACHE_BUSY: no entry, but a script for the key is running.
+    Status lookup(const std::string& key, unsigned long now, const CachedResponse*& entry);
+    // Fills entry from the headers of the script, false if they forbid sharing it
+    bool prepare(const HTTPResponse& response, unsigned long now, CachedResponse& entry) const;
+    // Kept if its lifetime is not over already
+    void store(const CachedResponse& entry);
+
+    // Waits for the script running for key; false if there is none
+    bool join(const std::string& key, int client_fd);
+    void cancel(int client_fd);
+    bool isWaiting(int client_fd) const;
+    // The script succeeded: its waiters, to be answered with its response
+    void finish(const std::string& key, std::vector<int>& waiters);
+    // No response to share: the waiters are handled again
+    void release(const std::string& key);
+    // Same, and identical requests skip the cache for validMs
+    void pass(const std::string& key, unsigned long now);
+    void collectReleased(std::set<int>& pending);
+    size_t getCapacity() const;
+
+private:
+    typedef std::list<CachedResponse> EntryList;
+
+    size_t _capacity;
+    unsigned long _validMs;
+    unsigned long _staleMs;
+    size_t _used;
+    // Most recently used first
+    EntryList _entries;
+    std::map<std::string, EntryList::iterator> _index;
+    // Keys with a script running -> requests waiting for it
+    std::map<std::string, std::vector<int> > _flights;
+    std::map<int, std::string> _waiters;
+    std::vector<int> _released;
+
+    CGICache(const CGICache&);
+    CGICache& operator=(const CGICache&);
+
+    void erase(EntryList::iterator it);
+    static size_t cost(const CachedResponse& entry);
+};
+
+#endif
@@ -2,32 +2,95 @@
 #include "CGIHandler.hpp"
 #include "HTTPResponse.hpp"
 #include "Server.hpp"
+#include "FastCGIPool.hpp"
+#include "CGISpawner.hpp"
+#include "CGIQueue.hpp"
+#include "CGICache.hpp"
 #include "Logger.hpp"
 #include "Utils.hpp"
 
 #include <iostream>
 
 #include <cstring>
+#include <cerrno>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <signal.h>
 #include <limits.h>
 
-CGIHandler::CGIHandler::CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, const HTTPRequest& request)
-    : _scriptPath(scriptPath), _request(request), _interpreterPath(interpreterPath), _pid(-1), _CGIOutput(""), _bytesSent(0), _started(false), _cgiFinished(false), _cgiExitStatus(-1) {
+CGIHandler::CGIHandler::CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, HTTPRequest& request)
+    : _scriptPath(scriptPath), _request(request), _interpreterPath(interpreterPath), _pid(-1), _spawner(NULL), _CGIOutput(""), _bytesSent(0), _started(false), _inputPaused(false), _outputPaused(false), _splicing(false), _outputReady(false), _fastcgiPool(NULL), _fastcgiFd(-1), _fastcgiInputClosed(false), _stdinEnded(false), _queue(NULL), _cache(NULL), _record(NULL), _cgiFinished(false), _cgiExitStatus(-1) {
     _outputPipeFd[0] = -1;
     _outputPipeFd[1] = -1;
     _inputPipeFd[0] = -1;
     _inputPipeFd[1] = -1;
-    setCGIInput(request.getBody().c_str());
 }
 
-CGIHandler::~CGIHandler() {}
+CGIHandler::~CGIHandler() {
+    if (_queue)
+        _queue->release();
+    // No response for the waiters: they run the script again
+    if (_cache)
+        _cache->release(_cacheKey);
+    delete _record;
+}
 
 // Getters
 int CGIHandler::getPid() const { return _pid; }
-int CGIHandler::getInputPipeFd() const { return _inputPipeFd[1]; }
-int CGIHandler::getOutputPipeFd() const { return _outputPipeFd[0]; }
+int CGIHandler::getInputPipeFd() const {
+    if (_fastcgiPool)
+        return _fastcgiInputClosed ? -1 : _fastcgiFd;
+    return _inputPipeFd[1];
+}
+int CGIHandler::getOutputPipeFd() const { return _fastcgiPool ? _fastcgiFd : _outputPipeFd[0]; }
+bool CGIHandler::isFastCGI() const { return _fastcgiPool != NULL; }
+void CGIHandler::setQueue(CGIQueue* queue) { _queue = queue; }
+
+void CGIHandler::recordFor(CGICache* cache, const std::string& key) {
+    _cache = cache;
+    _cacheKey = key;
+    _record = new CachedResponse();
+    _record->key = key;
+}
+
+// The waiters need not wait for the end of a response they cannot share
+void CGIHandler::stopRecording(unsigned long now) {
+    _cache->pass(_cacheKey, now);
+    _cache = NULL;
+    delete _record;
+    _record = NULL;
+}
+
+void CGIHandler::recordHeaders(const HTTPResponse& response, unsigned long now) {
+    if (_record && !_cache->prepare(response, now, *_record)) {
+        Logger::instance().log(DEBUG, "CGI cache: response to " + _cacheKey + " not cacheable");
+        stopRecording(now);
+    }
+}
+
+void CGIHandler::recordOutput(const std::string& output) {
+    if (!_record)
+        return;
+    // Beyond the budget of the whole cache it would never be stored
+    if (_record->body.size() + output.size() > _cache->getCapacity()) {
+        stopRecording(curr_time_ms());
+        return;
+    }
+    _record->body += output;
+}
+
+bool CGIHandler::isRecording() const { return _record != NULL; }
+
+const CachedResponse* CGIHandler::finishRecord(std::vector<int>& waiters) {
+    if (!_record)
+        return NULL;
+    _cache->store(*_record);
+    _cache->finish(_cacheKey, waiters);
+    _cache = NULL;
+    return _record;
+}
 std::string CGIHandler::getCGIInput() const { return _CGIInput; }
 std::string CGIHandler::getCGIOutput() const { return _CGIOutput; }
 
@@ -44,6 +107,23 @@ void CGIHandler::setOutputPipeFd(int outputPipeFd[2]) {
 void CGIHandler::setCGIInput(const std::string& CGIInput) { _CGIInput = CGIInput; }
 void CGIHandler::setCGIOutput(const std::string& CGIOutput) { _CGIOutput = CGIOutput; }
 
+int CGIHandler::decodeExitStatus(int waitStatus) {
+    if (WIFEXITED(waitStatus))
+        return WEXITSTATUS(waitStatus);
+    if (WIFSIGNALED(waitStatus))
+        return WTERMSIG(waitStatus);
+    return -1;
+}
+
+void CGIHandler::setExitStatus(int waitStatus) {
+    _cgiExitStatus = decodeExitStatus(waitStatus);
+    _cgiFinished = true;
+    // Already reaped: the pid may be reused, never signal it again
+    _pid = -1;
+}
+
+bool CGIHandler::hasExited() const { return _cgiFinished; }
+
 int CGIHandler::isCgiDone() {
     if (_cgiFinished) {
         return _cgiExitStatus;
@@ -55,15 +135,7 @@ int CGIHandler::isCgiDone() {
         // Process is still running
         return 0;
     } else if (result == _pid) {
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            if (WEXITSTATUS(status))
-                _cgiExitStatus = WEXITSTATUS(status);
-            else if (WTERMSIG(status))
-                _cgiExitStatus = WTERMSIG(status);
-        } else {
-            _cgiExitStatus = -1;
-        }
-        _cgiFinished = true;
+        setExitStatus(status);
         return _cgiExitStatus;
     } else {
         Logger::instance().log(ERROR, "isCGIDone: waitpid failed: " + std::string(to_string(errno)));
@@ -74,30 +146,46 @@ int CGIHandler::isCgiDone() {
 }
 
 int CGIHandler::writeToCGI() {
+    if (_fastcgiPool)
+        return writeToFastCGI();
     if (_inputPipeFd[1] == -1) {
         return -1;
     }
 
+    if (_bytesSent == _CGIInput.size()) {
+        // Swapped, not copied: the request goes on receiving into an empty buffer
+        _request.takeBody(_CGIInput);
+        _bytesSent = 0;
+    }
+    if (_CGIInput.empty()) {
+        // All data sent; the caller closes the input pipe
+        return _request.isComplete() ? 0 : 2;
+    }
+
     const char* bufferPtr = _CGIInput.c_str() + _bytesSent;
     ssize_t remaining = _CGIInput.size() - _bytesSent;
     ssize_t bytesWritten = write(_inputPipeFd[1], bufferPtr, remaining);
 
     if (bytesWritten > 0) {
         _bytesSent += bytesWritten;
-    } else if (bytesWritten == -1) {
+    } else if (bytesWritten == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        // Typically the script exited without reading all of its input
         Logger::instance().log(ERROR, "writeToCGI: Write error");
+        return -1;
     }
 
-    if (_bytesSent == _CGIInput.size()) {
-        // All data sent; close the input pipe
-        close(_inputPipeFd[1]);
-        _inputPipeFd[1] = -1;
-        return 0; // Indicate that writing is complete
-    }
+    if (getInputBacklog() == 0)
+        return _request.isComplete() ? 0 : 2;
+    return 1;
+}
 
-    return _bytesSent;
+size_t CGIHandler::getInputBacklog() const {
+    return _CGIInput.size() - _bytesSent + _request.getBodySize();
 }
 
+bool CGIHandler::isInputPaused() const { return _inputPaused; }
+void CGIHandler::setInputPaused(bool paused) { _inputPaused = paused; }
+
 bool CGIHandler::hasReceivedBody() {
     std::string sequence = "\r\n\r\n";
     size_t pos = getCGIOutput().find(sequence);
@@ -105,30 +193,114 @@ bool CGIHandler::hasReceivedBody() {
     if (pos == std::string::npos)
         return false;
     return ((pos + 4) < getCGIOutput().length());
-} 
+}
+
+bool CGIHandler::takeHeaders(std::string& headers) {
+    // Scripts may end their header lines with a bare LF
+    size_t end = _CGIOutput.find("\r\n\r\n");
+    size_t separator = 4;
+    size_t lfEnd = _CGIOutput.find("\n\n");
+    if (lfEnd != std::string::npos && (end == std::string::npos || lfEnd < end)) {
+        end = lfEnd;
+        separator = 2;
+    }
+    if (end == std::string::npos)
+        return false;
+    headers = _CGIOutput.substr(0, end);
+    _CGIOutput.erase(0, end + separator);
+    return true;
+}
+
+void CGIHandler::takeOutput(std::string& output) {
+    output.clear();
+    output.swap(_CGIOutput);
+}
+
+bool CGIHandler::isOutputPaused() const { return _outputPaused; }
+void CGIHandler::setOutputPaused(bool paused) { _outputPaused = paused; }
+bool CGIHandler::isSplicing() const { return _splicing; }
+void CGIHandler::setSplicing(bool splicing) { _splicing = splicing; }
+bool CGIHandler::isOutputReady() const { return _outputReady; }
+void CGIHandler::setOutputReady(bool ready) { _outputReady = ready; }
+
+// _CGIInput holds the encoded records, the body is framed as stdin records
+// as it is taken from the request
+int CGIHandler::writeToFastCGI() {
+    if (_fastcgiFd == -1 || _fastcgiInputClosed)
+        return -1;
+    while (true) {
+        if (_bytesSent < _CGIInput.size()) {
+            ssize_t bytesWritten = send(_fastcgiFd, _CGIInput.data() + _bytesSent, _CGIInput.size() - _bytesSent, 0);
+            if (bytesWritten > 0) {
+                _bytesSent += bytesWritten;
+                continue;
+            }
+            if (bytesWritten == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return 1;
+            Logger::instance().log(ERROR, std::string("writeToFastCGI: ") + strerror(errno));
+            return -1;
+        }
+        if (_stdinEnded)
+            return 0;
+
+        std::string body;
+        _request.takeBody(body);
+        if (body.empty() && !_request.isComplete())
+            return 2;
+        _CGIInput.clear();
+        _bytesSent = 0;
+        if (!body.empty())
+            FastCGIStream::appendStdin(_CGIInput, body.data(), body.size());
+        if (_request.isComplete()) {
+            FastCGIStream::appendStdin(_CGIInput, "", 0);
+            _stdinEnded = true;
+        }
+    }
+}
+
+// 0 once the reply is over, ended by the application or not
+int CGIHandler::readFromFastCGI() {
+    if (_fastcgiFd == -1)
+        return -1;
+    char buffer[16384];
+    ssize_t bytesRead = recv(_fastcgiFd, buffer, sizeof(buffer), 0);
+    if (bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return -1;
+    if (bytesRead <= 0 || !_fastcgi.decode(buffer, bytesRead, _CGIOutput)) {
+        Logger::instance().log(ERROR, "FastCGI connection to " + _fastcgiPool->getAddress() + " lost before the end of the reply");
+        _cgiFinished = true;
+        _cgiExitStatus = -1;
+        return 0;
+    }
+    if (_fastcgi.isEnded()) {
+        _cgiFinished = true;
+        _cgiExitStatus = _fastcgi.getAppStatus();
+        return 0;
+    }
+    return bytesRead;
+}
 
 int CGIHandler::readFromCGI() {
+    if (_fastcgiPool)
+        return readFromFastCGI();
     if (_outputPipeFd[0] == -1) {
         return -1;
     }
     char buffer[4096];
     ssize_t bytesRead = read(_outputPipeFd[0], buffer, sizeof(buffer));
-    if (bytesRead > 0) {
+    // On EOF the caller closes the pipe, once it stopped watching it
+    if (bytesRead > 0)
         _CGIOutput.append(buffer, bytesRead);
-    } else if (bytesRead == 0) {
-        close(_outputPipeFd[0]);
-        _outputPipeFd[0] = -1;
-    }
     return bytesRead;
 }
 
-bool CGIHandler::hasTimedOut() const {
-    unsigned long currentTime = curr_time_ms();
-    return (currentTime - _startTime) > CGI_TIMEOUT_MS;
-}
-
 void CGIHandler::terminateCGI() {
-    if (_pid > 0) {
+    if (_pid > 0 && _spawner) {
+        // Not a child of the worker: its helper kills it unless already reaped,
+        // the exit record that follows matches no request anymore
+        _spawner->terminate(_pid);
+        _pid = -1;
+    } else if (_pid > 0) {
         kill(_pid, SIGKILL);
         waitpid(_pid, NULL, 0);
         _pid = -1;
@@ -145,8 +317,7 @@ bool CGIHandler::endsWith(const std::string& str, const std::string& suffix) con
     }
 }
 
-bool CGIHandler::startCGI() {
-    _startTime = curr_time_ms();
+bool CGIHandler::startCGI(CGISpawner* spawner) {
     Logger::instance().log(DEBUG, "Startin CGI script: " + _scriptPath);
 
     std::string interpreter = _interpreterPath;
@@ -159,70 +330,97 @@ bool CGIHandler::startCGI() {
     }
     if (pipe(_outputPipeFd) == -1) {
         Logger::instance().log(ERROR, std::string("executeCGI: Output pipe failed: ") + strerror(errno));
+        close(_inputPipeFd[0]);
+        close(_inputPipeFd[1]);
+        _inputPipeFd[0] = -1;
+        _inputPipeFd[1] = -1;
         return false;
     }
+    // dup2() clears the flag on the script's stdin and stdout
+    for (int i = 0; i < 2; ++i) {
+        set_close_on_exec(_inputPipeFd[i]);
+        set_close_on_exec(_outputPipeFd[i]);
+    }
 
     Logger::instance().log(DEBUG, std::string("pipe fds : INPUT 0 : ") + to_string(_inputPipeFd[0]) + " - INPUT 1 : " + to_string(_inputPipeFd[1]) + " - OUTPUT 0 : " + to_string(_outputPipeFd[0])  + " - OUTPUT 1 : " + to_string(_outputPipeFd[1]));
 
-    int pid = fork();
-    if (pid == 0) {
-        // Processus enfant : exécution du script CGI
-        close(_outputPipeFd[0]);
-        dup2(_outputPipeFd[1], STDOUT_FILENO);
-        close(_outputPipeFd[1]);
-        close(_inputPipeFd[1]);
-        dup2(_inputPipeFd[0], STDIN_FILENO);
-        close(_inputPipeFd[0]);
-
-        setupEnvironment(_request, _scriptPath);
-
-        execl(interpreter.c_str(), interpreter.c_str(), _scriptPath.c_str(), NULL);
-        Logger::instance().log(ERROR, std::string("executeCGI: Failed to execute CGI script: ") + _scriptPath + std::string(". Error: ") + strerror(errno));
-        exit(EXIT_FAILURE);
-    } else if (pid > 0){
+    Environment env = buildEnvironment(_request, _scriptPath);
+    int pid = spawner ? spawner->spawn(interpreter, _scriptPath, env, _inputPipeFd[0], _outputPipeFd[1]) : -1;
+    if (pid != -1)
+        _spawner = spawner;
+    else
+        pid = CGISpawner::launch(interpreter, _scriptPath, env, _inputPipeFd[0], _outputPipeFd[1]);
+    if (pid > 0){
         _pid = pid;
         _started = true;
+        // Forget the child's ends, closeInputPipe/closeOutputPipe must not close them twice
         close(_outputPipeFd[1]);
+        _outputPipeFd[1] = -1;
         close(_inputPipeFd[0]);
+        _inputPipeFd[0] = -1;
+        // stdin and stdout are serviced together by the event loop, neither may block
+        fcntl(_inputPipeFd[1], F_SETFL, O_NONBLOCK);
+        fcntl(_outputPipeFd[0], F_SETFL, O_NONBLOCK);
         return true;
-    } else if (pid == -1) {
-        Logger::instance().log(ERROR, "executeCGI: Fork failed: " + std::string(strerror(errno)));
-        close(_inputPipeFd[0]);
-        close(_inputPipeFd[1]);
-        close(_outputPipeFd[0]);
-        close(_outputPipeFd[1]);
-        return false;
     }
+    for (int i = 0; i < 2; ++i) {
+        close(_inputPipeFd[i]);
+        close(_outputPipeFd[i]);
+        _inputPipeFd[i] = -1;
+        _outputPipeFd[i] = -1;
+    }
+    return false;
+}
+
+bool CGIHandler::startFastCGI(FastCGIPool& pool) {
+    Logger::instance().log(DEBUG, "Passing " + _scriptPath + " to FastCGI application " + pool.getAddress());
+    _fastcgiFd = pool.acquire();
+    if (_fastcgiFd == -1)
+        return false;
+    _fastcgiPool = &pool;
+    _started = true;
+    FastCGIStream::appendBeginRequest(_CGIInput, pool.keepsConnections());
+    FastCGIStream::appendParams(_CGIInput, buildEnvironment(_request, _scriptPath));
+    _bytesSent = 0;
     return true;
 }
 
-void CGIHandler::setupEnvironment(const HTTPRequest& request, std::string scriptPath) {
+// Shared by the script environment and the FastCGI parameters
+CGIHandler::Environment CGIHandler::buildEnvironment(const HTTPRequest& request, std::string scriptPath) const {
+    Environment env;
     char absPath[PATH_MAX];
     if (realpath(scriptPath.c_str(), absPath) == NULL) {
         Logger::instance().log(ERROR, "Failed to get absolute path of the CGI script.");
+        absPath[0] = '\0';
     }
-    
+
     std::string contentType = request.getStrHeader("Content-Type");
     if (!contentType.empty()) {
-        setenv("CONTENT_TYPE", contentType.c_str(), 1);
+        env.push_back(std::make_pair("CONTENT_TYPE", contentType));
     }
 
     // Variables CGI standard
-    setenv("REQUEST_METHOD", request.getMethod().c_str(), 1);
-    setenv("CONTENT_LENGTH", to_string(request.getBody().size()).c_str(), 1);
-    setenv("GATEWAY_INTERFACE", "CGI/1.1", 1);
-    setenv("SCRIPT_FILENAME", absPath, 1);
-    setenv("SCRIPT_NAME", scriptPath.c_str(), 1);
-    setenv("QUERY_STRING", request.getQueryString().c_str(), 1);
-    setenv("REDIRECT_STATUS", "200", 1);
-    setenv("SERVER_PROTOCOL", "HTTP/1.1", 1); 
-    std::string host = request.getStrHeader("Host");
-    setenv("SERVER_NAME", host.c_str(), 1);
-    setenv("SERVER_SOFTWARE", "webserv/1.0", 1);
+    env.push_back(std::make_pair("REQUEST_METHOD", request.getMethod()));
+    // Started before the body is received only when its length is announced
+    size_t contentLength = request.isChunked() ? request.getBodyReceived() : request.getContentLength();
+    env.push_back(std::make_pair("CONTENT_LENGTH", to_string(contentLength)));
+    env.push_back(std::make_pair("GATEWAY_INTERFACE", "CGI/1.1"));
+    env.push_back(std::make_pair("SCRIPT_FILENAME", std::string(absPath)));
+    env.push_back(std::make_pair("SCRIPT_NAME", scriptPath));
+    env.push_back(std::make_pair("QUERY_STRING", request.getQueryString()));
+    env.push_back(std::make_pair("REDIRECT_STATUS", "200"));
+    env.push_back(std::make_pair("SERVER_PROTOCOL", "HTTP/1.1"));
+    env.push_back(std::make_pair("SERVER_NAME", request.getStrHeader("Host")));
+    env.push_back(std::make_pair("SERVER_SOFTWARE", "webserv/1.0"));
+    return env;
 }
 
-
 void CGIHandler::closeInputPipe() {
+    if (_fastcgiPool) {
+        // Same socket as the reply, which may still be coming
+        _fastcgiInputClosed = true;
+        return;
+    }
     if (_inputPipeFd[0] != -1) {
         close(_inputPipeFd[0]);
         _inputPipeFd[0] = -1;
@@ -234,6 +432,17 @@ void CGIHandler::closeInputPipe() {
 }
 
 void CGIHandler::closeOutputPipe() {
+    if (_fastcgiPool) {
+        if (_fastcgiFd == -1)
+            return;
+        // Reusable only once both the request and the reply went through completely
+        if (_fastcgi.isEnded() && _stdinEnded && _bytesSent == _CGIInput.size() && _fastcgiPool->keepsConnections())
+            _fastcgiPool->release(_fastcgiFd);
+        else
+            close(_fastcgiFd);
+        _fastcgiFd = -1;
+        return;
+    }
     if (_outputPipeFd[0] != -1) {
         close(_outputPipeFd[0]);
         _outputPipeFd[0] = -1;
@@ -3,19 +3,56 @@
 #define CGIHANDLER_HPP
 
 #include "HTTPRequest.hpp"
+#include "FastCGIStream.hpp"
 
 #include <string>
+#include <vector>
+#include <utility>
 
 #include <stdlib.h>
 
 class Server;
+class HTTPResponse;
+class FastCGIPool;
+class CGISpawner;
+class CGIQueue;
+class CGICache;
+struct CachedResponse;
 
 class CGIHandler {
 public:
-    CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, const HTTPRequest& request);
+    // Deadline armed by the event loop when the script starts
+    static const unsigned long CGI_TIMEOUT_MS = 5000;
+    // Output waiting for the client above which the pipe is no longer read,
+    // and below which reading resumes
+    static const size_t OUTPUT_HIGH_WATER = 256 * 1024;
+    static const size_t OUTPUT_LOW_WATER = 64 * 1024;
+    // Request body waiting for the script above which the socket is no longer read
+    static const size_t INPUT_HIGH_WATER = 256 * 1024;
+
+    // The request must outlive the handler: its body is read as it arrives
+    CGIHandler(const std::string& scriptPath, const std::string& interpreterPath, HTTPRequest& request);
     ~CGIHandler();
 
-    bool startCGI();
+    typedef std::vector<std::pair<std::string, std::string> > Environment;
+
+    // Forked by a spawn helper when one is given, by the worker otherwise
+    bool startCGI(CGISpawner* spawner = NULL);
+    // The script runs in a FastCGI application instead of a child process:
+    // the "pipes" are then both the application socket
+    bool startFastCGI(FastCGIPool& pool);
+    bool isFastCGI() const;
+    // Slot of the location's CGI queue, released with the handler
+    void setQueue(CGIQueue* queue);
+    // The script runs for the requests of cache waiting on key: its output
+    // is kept as long as its headers and size allow it to be shared
+    void recordFor(CGICache* cache, const std::string& key);
+    void recordHeaders(const HTTPResponse& response, unsigned long now);
+    void recordOutput(const std::string& output);
+    bool isRecording() const;
+    // The script succeeded: stores the response, NULL if it cannot be
+    // shared. Waiters get the requests to answer with it.
+    const CachedResponse* finishRecord(std::vector<int>& waiters);
 
     // Getters
     int getPid() const;
@@ -34,21 +71,43 @@ public:
     void closeInputPipe();
     void closeOutputPipe();
 
+    // 0 once the whole body is written, -1 on error, 1 while bytes are
+    // queued, 2 while waiting for the client to send more
     int writeToCGI();
     int readFromCGI();
+    // Request body received but not written to the script yet
+    size_t getInputBacklog() const;
+    bool isInputPaused() const;
+    void setInputPaused(bool paused);
 
     int isCgiDone();
+    // Records the waitpid() status of the child once it has been reaped elsewhere
+    void setExitStatus(int waitStatus);
+    bool hasExited() const;
     void terminateCGI();
-    bool hasTimedOut() const;
 
     bool hasReceivedBody();
+    // Once the header block is complete, moves it to headers and leaves the
+    // start of the body in the output buffer
+    bool takeHeaders(std::string& headers);
+    void takeOutput(std::string& output);
+    bool isOutputPaused() const;
+    void setOutputPaused(bool paused);
+    // Output past the headers goes from the pipe to the socket with splice()
+    bool isSplicing() const;
+    void setSplicing(bool splicing);
+    // While splicing: the pipe may have data, so it is not polled
+    bool isOutputReady() const;
+    void setOutputReady(bool ready);
 
 private:
     std::string _scriptPath;
-    const HTTPRequest& _request;
+    HTTPRequest& _request;
 	std::string _interpreterPath;
 
     int _pid;
+    // Spawner whose helper started the script, NULL when it is a child of the worker
+    CGISpawner* _spawner;
     int _inputPipeFd[2];
     int _outputPipeFd[2];
 
@@ -57,13 +116,30 @@ private:
 
     size_t  _bytesSent;
     bool    _started;
-
-    unsigned long _startTime;
-    static const unsigned long CGI_TIMEOUT_MS = 5000;
-
-	void setupEnvironment(const HTTPRequest&, std::string scriptPath);
+    bool    _inputPaused;
+    bool    _outputPaused;
+    bool    _splicing;
+    bool    _outputReady;
+
+    FastCGIPool* _fastcgiPool;
+    int     _fastcgiFd;
+    FastCGIStream _fastcgi;
+    bool    _fastcgiInputClosed;
+    // The empty stdin record ending the body is queued
+    bool    _stdinEnded;
+    CGIQueue* _queue;
+    CGICache* _cache;
+    std::string _cacheKey;
+    // Output kept so far, NULL once it cannot be cached
+    CachedResponse* _record;
+
+	Environment buildEnvironment(const HTTPRequest&, std::string scriptPath) const;
+    int writeToFastCGI();
+    int readFromFastCGI();
 
     bool endsWith(const std::string& str, const std::string& suffix) const;
+    void stopRecording(unsigned long now);
+    static int decodeExitStatus(int waitStatus);
 
 	bool _cgiFinished;
     int _cgiExitStatus;
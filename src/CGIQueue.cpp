@@ -0,0 +1,43 @@
+// CGIQueue.cpp
+#include "CGIQueue.hpp"
+
+#include <algorithm>
+
+CGIQueue::CGIQueue(size_t maxRunning, size_t maxWaiting)
+    : _maxRunning(maxRunning), _maxWaiting(maxWaiting), _running(0) {}
+
+CGIQueue::Admission CGIQueue::admit(int client_fd) {
+    if (nextReady() == client_fd) {
+        _waiting.pop_front();
+        ++_running;
+        return CGI_START;
+    }
+    if (std::find(_waiting.begin(), _waiting.end(), client_fd) != _waiting.end())
+        return CGI_WAIT;
+    // Never ahead of the requests already waiting
+    if (_waiting.empty() && _running < _maxRunning) {
+        ++_running;
+        return CGI_START;
+    }
+    if (_waiting.size() >= _maxWaiting)
+        return CGI_REJECT;
+    _waiting.push_back(client_fd);
+    return CGI_WAIT;
+}
+
+void CGIQueue::release() {
+    if (_running > 0)
+        --_running;
+}
+
+void CGIQueue::cancel(int client_fd) {
+    std::deque<int>::iterator it = std::find(_waiting.begin(), _waiting.end(), client_fd);
+    if (it != _waiting.end())
+        _waiting.erase(it);
+}
+
+int CGIQueue::nextReady() const {
+    if (_waiting.empty() || _running >= _maxRunning)
+        return -1;
+    return _waiting.front();
+}
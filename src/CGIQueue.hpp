@@ -0,0 +1,34 @@
+// CGIQueue.hpp
+#ifndef CGIQUEUE_HPP
+#define CGIQUEUE_HPP
+
+#include <deque>
+#include <cstddef>
+
+// Bounds the CGI scripts of a location running at once. Requests above the
+// limit wait in arrival order, up to maxWaiting, and are refused beyond.
+class CGIQueue {
+public:
+    enum Admission { CGI_START, CGI_WAIT, CGI_REJECT };
+    // Retry-After sent with the 503 of a full queue
+    static const int RETRY_AFTER_SECONDS = 1;
+
+    CGIQueue(size_t maxRunning, size_t maxWaiting);
+
+    // CGI_START takes a slot, released by release() once the script is over.
+    // A waiting request is only started from the head of the queue.
+    Admission admit(int client_fd);
+    void release();
+    // Waiting request given up: connection closed or timed out
+    void cancel(int client_fd);
+    // Waiting request a slot is free for, -1 if none
+    int nextReady() const;
+
+private:
+    size_t _maxRunning;
+    size_t _maxWaiting;
+    size_t _running;
+    std::deque<int> _waiting;
+};
+
+#endif
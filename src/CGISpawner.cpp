@@ -0,0 +1,358 @@
+// CGISpawner.cpp
+#include "CGISpawner.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+// Largest spawn request: interpreter, script and environment
+static const size_t MAX_REQUEST = 65536;
+
+// First byte of each message sent to a helper
+static const char SPAWN_REQUEST = 'S';
+static const char KILL_REQUEST = 'K';
+
+// Written by the helper for each script it reaped
+struct ExitRecord {
+    pid_t pid;
+    int status;
+};
+
+// Write end of the status pipe, for the SIGCHLD handler of the helper
+static int exitStatusFd = -1;
+
+static void reportExits(int) {
+    int savedErrno = errno;
+    ExitRecord record;
+    // Records are smaller than PIPE_BUF: each write is atomic
+    while ((record.pid = waitpid(-1, &record.status, WNOHANG)) > 0)
+        write(exitStatusFd, &record, sizeof(record));
+    errno = savedErrno;
+}
+
+CGISpawner::CGISpawner() : _next(0), _statusFd(-1) {}
+
+CGISpawner::~CGISpawner() {
+    if (_statusFd != -1)
+        close(_statusFd);
+    for (size_t i = 0; i < _helpers.size(); ++i) {
+        if (_helpers[i].socket == -1)
+            continue;
+        close(_helpers[i].socket);
+        while (waitpid(_helpers[i].pid, NULL, 0) == -1 && errno == EINTR)
+            ;
+    }
+}
+
+bool CGISpawner::start(size_t count) {
+    int statusPipe[2];
+    if (count == 0)
+        return false;
+    if (pipe(statusPipe) == -1) {
+        Logger::instance().log(ERROR, std::string("CGISpawner: pipe failed: ") + strerror(errno));
+        return false;
+    }
+    set_close_on_exec(statusPipe[0]);
+    set_close_on_exec(statusPipe[1]);
+    for (size_t i = 0; i < count; ++i) {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) == -1) {
+            Logger::instance().log(ERROR, std::string("CGISpawner: socketpair failed: ") + strerror(errno));
+            break;
+        }
+        set_close_on_exec(sockets[0]);
+        set_close_on_exec(sockets[1]);
+        pid_t pid = fork();
+        if (pid == -1) {
+            Logger::instance().log(ERROR, std::string("CGISpawner: fork failed: ") + strerror(errno));
+            close(sockets[0]);
+            close(sockets[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(sockets[0]);
+            close(statusPipe[0]);
+            for (size_t j = 0; j < _helpers.size(); ++j)
+                close(_helpers[j].socket);
+            runHelper(sockets[1], statusPipe[1]);
+        }
+        close(sockets[1]);
+        Helper helper;
+        helper.pid = pid;
+        helper.socket = sockets[0];
+        _helpers.push_back(helper);
+    }
+    // Only the helpers write: the pipe reports EOF once they are all gone
+    close(statusPipe[1]);
+    if (_helpers.empty()) {
+        close(statusPipe[0]);
+        return false;
+    }
+    _statusFd = statusPipe[0];
+    fcntl(_statusFd, F_SETFL, O_NONBLOCK);
+    Logger::instance().log(INFO, "Started " + to_string(_helpers.size()) + " CGI spawn helpers");
+    return true;
+}
+
+// After its type, a spawn request is "interpreter\0script\0" followed by
+// "name\0value\0" pairs; the two pipe ends travel as SCM_RIGHTS. A kill
+// request only carries the pid and gets no reply.
+static bool sendRequest(int socket, const std::string& request, int stdinFd, int stdoutFd) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov;
+    struct msghdr msg;
+    std::memset(&control, 0, sizeof(control));
+    std::memset(&msg, 0, sizeof(msg));
+    iov.iov_base = const_cast<char*>(request.data());
+    iov.iov_len = request.size();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds[2] = { stdinFd, stdoutFd };
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    while ((sent = sendmsg(socket, &msg, 0)) == -1 && errno == EINTR)
+        ;
+    return sent == static_cast<ssize_t>(request.size());
+}
+
+static ssize_t receiveRequest(int socket, char* buffer, size_t size, int fds[2]) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct iovec iov;
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+    fds[0] = -1;
+    fds[1] = -1;
+
+    ssize_t length = recvmsg(socket, &msg, 0);
+    if (length <= 0)
+        return length;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+        std::memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+    // A truncated request cannot be run
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        if (fds[0] != -1)
+            close(fds[0]);
+        if (fds[1] != -1)
+            close(fds[1]);
+        fds[0] = -1;
+        fds[1] = -1;
+    }
+    return length;
+}
+
+pid_t CGISpawner::launch(const std::string& interpreter, const std::string& script, const Environment& env,
+                         int stdinFd, int stdoutFd) {
+    std::vector<std::string> variables;
+    for (size_t i = 0; i < env.size(); ++i)
+        variables.push_back(env[i].first + "=" + env[i].second);
+    // The interpreter still has to find the commands the script runs
+    const char* path = getenv("PATH");
+    if (path)
+        variables.push_back(std::string("PATH=") + path);
+    std::vector<char*> envp;
+    for (size_t i = 0; i < variables.size(); ++i)
+        envp.push_back(const_cast<char*>(variables[i].c_str()));
+    envp.push_back(NULL);
+    char* argv[] = { const_cast<char*>(interpreter.c_str()), const_cast<char*>(script.c_str()), NULL };
+
+    // Every other descriptor of the server is close-on-exec
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdinFd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stdoutFd, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, stdinFd);
+    posix_spawn_file_actions_addclose(&actions, stdoutFd);
+    // Neither the signals blocked nor the SIGPIPE ignored by the server are inherited
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, interpreter.c_str(), &actions, &attributes, argv, &envp[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    if (error) {
+        Logger::instance().log(ERROR, "executeCGI: Failed to execute CGI script: " + script + ". Error: " + strerror(error));
+        return -1;
+    }
+    return pid;
+}
+
+// Fields of a spawn request, separated by '\0'
+static std::vector<std::string> splitRequest(const char* request, size_t length) {
+    std::vector<std::string> fields;
+    for (size_t pos = 0; pos < length; ) {
+        size_t end = pos;
+        while (end < length && request[end] != '\0')
+            ++end;
+        fields.push_back(std::string(request + pos, end - pos));
+        pos = end + 1;
+    }
+    return fields;
+}
+
+// SIGCHLD is blocked meanwhile: a script still waited for cannot be reaped,
+// and a pid that is not one of them anymore may belong to another process
+static void killScript(pid_t pid) {
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &previous);
+    siginfo_t info;
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+        kill(pid, SIGKILL);
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+}
+
+// Main loop of a helper: one request, one spawn, one reply with the pid
+void CGISpawner::runHelper(int socket, int statusFd) {
+    // The signal pipe belongs to the worker
+    close(serverSignal::pipe_fd[0]);
+    close(serverSignal::pipe_fd[1]);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    exitStatusFd = statusFd;
+    struct sigaction sa;
+    sa.sa_handler = reportExits;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    std::vector<char> buffer(MAX_REQUEST);
+    while (true) {
+        int fds[2];
+        ssize_t length = receiveRequest(socket, &buffer[0], buffer.size(), fds);
+        if (length == -1 && errno == EINTR)
+            continue;
+        // The worker is gone
+        if (length <= 0)
+            break;
+        pid_t pid = -1;
+        if (buffer[0] == KILL_REQUEST) {
+            if (length == static_cast<ssize_t>(1 + sizeof(pid))) {
+                std::memcpy(&pid, &buffer[1], sizeof(pid));
+                killScript(pid);
+            }
+            if (fds[0] != -1)
+                close(fds[0]);
+            if (fds[1] != -1)
+                close(fds[1]);
+            continue;
+        }
+        std::vector<std::string> fields;
+        if (buffer[0] == SPAWN_REQUEST)
+            fields = splitRequest(&buffer[1], length - 1);
+        if (fds[0] != -1 && fds[1] != -1 && fields.size() >= 2) {
+            Environment env;
+            for (size_t i = 2; i + 1 < fields.size(); i += 2)
+                env.push_back(std::make_pair(fields[i], fields[i + 1]));
+            pid = launch(fields[0], fields[1], env, fds[0], fds[1]);
+        }
+        if (fds[0] != -1)
+            close(fds[0]);
+        if (fds[1] != -1)
+            close(fds[1]);
+        send(socket, &pid, sizeof(pid), 0);
+    }
+    _exit(0);
+}
+
+pid_t CGISpawner::spawn(const std::string& interpreter, const std::string& script, const Environment& env,
+                        int stdinFd, int stdoutFd) {
+    std::string request(1, SPAWN_REQUEST);
+    request.append(interpreter).append(1, '\0');
+    request.append(script).append(1, '\0');
+    for (size_t i = 0; i < env.size(); ++i)
+        request.append(env[i].first).append(1, '\0').append(env[i].second).append(1, '\0');
+    if (request.size() > MAX_REQUEST) {
+        Logger::instance().log(WARNING, "CGI environment too large for the spawn helpers");
+        return -1;
+    }
+
+    for (size_t tries = 0; tries < _helpers.size(); ++tries) {
+        Helper& helper = _helpers[_next];
+        _next = (_next + 1) % _helpers.size();
+        if (helper.socket == -1)
+            continue;
+        pid_t pid;
+        ssize_t received = -1;
+        if (sendRequest(helper.socket, request, stdinFd, stdoutFd)) {
+            while ((received = recv(helper.socket, &pid, sizeof(pid), 0)) == -1 && errno == EINTR)
+                ;
+        }
+        if (received == static_cast<ssize_t>(sizeof(pid))) {
+            if (pid > 0)
+                _owners[pid] = &helper - &_helpers[0];
+            return pid;
+        }
+        // Reaped by the event loop like any other child
+        Logger::instance().log(WARNING, "CGI spawn helper " + to_string(helper.pid) + " is gone");
+        close(helper.socket);
+        helper.socket = -1;
+    }
+    return -1;
+}
+
+void CGISpawner::terminate(pid_t pid) {
+    std::map<pid_t, size_t>::iterator owner = _owners.find(pid);
+    if (owner == _owners.end())
+        return;
+    Helper& helper = _helpers[owner->second];
+    std::string request(1, KILL_REQUEST);
+    request.append(reinterpret_cast<const char*>(&pid), sizeof(pid));
+    ssize_t sent = -1;
+    if (helper.socket != -1) {
+        while ((sent = send(helper.socket, request.data(), request.size(), 0)) == -1 && errno == EINTR)
+            ;
+    }
+    if (sent == -1)
+        Logger::instance().log(WARNING, "Cannot kill CGI script " + to_string(pid) + ": its spawn helper is gone");
+}
+
+int CGISpawner::getStatusFd() const { return _statusFd; }
+
+bool CGISpawner::readStatus(pid_t& pid, int& status) {
+    ExitRecord record;
+    if (_statusFd == -1 || read(_statusFd, &record, sizeof(record)) != static_cast<ssize_t>(sizeof(record)))
+        return false;
+    pid = record.pid;
+    status = record.status;
+    _owners.erase(pid);
+    return true;
+}
@@ -0,0 +1,60 @@
+// CGISpawner.hpp
+#ifndef CGISPAWNER_HPP
+#define CGISPAWNER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+#include <sys/types.h>
+
+// Helper processes forked while the worker is still small, which fork and
+// exec the CGI scripts on its behalf: the cost of fork() no longer grows with
+// the memory of the worker. Scripts are children of a helper, which reports
+// their exit status through a pipe.
+class CGISpawner {
+public:
+    typedef std::vector<std::pair<std::string, std::string> > Environment;
+
+    CGISpawner();
+    // Helpers exit once their socket is closed
+    ~CGISpawner();
+
+    // Forks count helpers. False when none could be started.
+    bool start(size_t count);
+    // Runs "interpreter script" with stdinFd and stdoutFd as its standard
+    // input and output. The script pid, or -1 when no helper could start it.
+    pid_t spawn(const std::string& interpreter, const std::string& script, const Environment& env,
+                int stdinFd, int stdoutFd);
+    // Starts the script from the calling process with posix_spawn(), with
+    // only env and PATH in its environment. -1 on failure.
+    static pid_t launch(const std::string& interpreter, const std::string& script, const Environment& env,
+                        int stdinFd, int stdoutFd);
+    // Kills a script started by spawn() through the helper that reaps it:
+    // its pid is never signalled once reaped. The exit status still follows.
+    void terminate(pid_t pid);
+    // Readable when a script spawned by a helper exited
+    int getStatusFd() const;
+    // Next exit status reported by the helpers, false when none is pending
+    bool readStatus(pid_t& pid, int& status);
+
+private:
+    struct Helper {
+        pid_t pid;
+        int socket;
+    };
+    std::vector<Helper> _helpers;
+    size_t _next;
+    int _statusFd;
+    // Scripts not reported as exited yet -> index of their helper
+    std::map<pid_t, size_t> _owners;
+
+    static void runHelper(int socket, int statusFd);
+
+    CGISpawner(const CGISpawner&);
+    CGISpawner& operator=(const CGISpawner&);
+};
+
+#endif
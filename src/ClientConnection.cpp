@@ -5,12 +5,26 @@
 #include "Server.hpp"
 #include "HTTPRequest.hpp"
 #include "HTTPResponse.hpp"
+#include "Compressor.hpp"
 
 #include <unistd.h>
 #include <errno.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/uio.h>
+
+#if defined(__linux__)
+# include <fcntl.h>
+# include <sys/ioctl.h>
+# include <sys/sendfile.h>
+#elif defined(__APPLE__)
+# include <sys/socket.h>
+#endif
 
 ClientConnection::ClientConnection(Server* server)
-    : _server(server), _request(NULL), _response(NULL), _cgiHandler(NULL), _responseOffset(0), _isSending(false), _exchangeOver(false), _used(false) {}
+    : _server(server), _request(NULL), _response(NULL), _cgiHandler(NULL), _cgiQueue(NULL), _cgiCache(NULL), _responseOffset(0), _rangeIndex(0), _prefixOffset(0), _fileOffset(0), _fileRemaining(0), _trailerOffset(0), _encodedOffset(0), _streamDone(false), _streamLimited(false), _streamRemaining(0), _location(NULL), _isSending(false), _exchangeOver(false), _used(false), _closeRequested(false) {}
 
 ClientConnection::~ClientConnection() {
     delete _request;
@@ -21,17 +35,49 @@ Server* ClientConnection::getServer() const { return _server; }
 HTTPRequest* ClientConnection::getRequest() const { return _request; }
 HTTPResponse* ClientConnection::getResponse() const { return _response; }
 CGIHandler* ClientConnection::getCgiHandler() const { return _cgiHandler; }
+CGIQueue* ClientConnection::getCgiQueue() const { return _cgiQueue; }
+CGICache* ClientConnection::getCgiCache() const { return _cgiCache; }
 bool ClientConnection::getExchangeOver() const { return _exchangeOver; }
 bool ClientConnection::getUsed() const { return _used; }
+Timer& ClientConnection::getTimer() { return _timer; }
+bool ClientConnection::getCloseRequested() const { return _closeRequested; }
+bool ClientConnection::hasBufferedInput() const { return !_inputBuffer.empty(); }
+const Location* ClientConnection::getLocation() const { return _location; }
+const std::string& ClientConnection::getAcceptEncoding() const { return _acceptEncoding; }
 
 void ClientConnection::setExchangeOver(bool value) { _exchangeOver = value; }
 void ClientConnection::setCgiHandler(CGIHandler* cgiHandler) { this->_cgiHandler = cgiHandler; }
 void ClientConnection::setRequest(HTTPRequest* request) { this->_request = request; }
 void ClientConnection::setResponse(HTTPResponse* response) { this->_response = response; }
 void ClientConnection::setRequestActivity(unsigned long time) { _request->setLastActivity(time); }
+void ClientConnection::setCloseRequested(bool value) { _closeRequested = value; }
+
+void ClientConnection::setEncodingContext(const Location* location, const std::string& acceptEncoding) {
+    _location = location;
+    _acceptEncoding = acceptEncoding;
+}
+
+void ClientConnection::setCgiQueue(CGIQueue* queue) {
+    _cgiQueue = queue;
+}
+
+void ClientConnection::setCgiCache(CGICache* cache) {
+    _cgiCache = cache;
+}
+
+void ClientConnection::bufferInput(const char* data, size_t len) {
+    _inputBuffer.append(data, len);
+}
+
+void ClientConnection::takeBufferedInput(std::string& input) {
+    input.clear();
+    input.swap(_inputBuffer);
+}
 
 void ClientConnection::prepareResponse() {
-    if (_server->getConfig().errorPages.find(_response->getStatusCode()) !=  _server->getConfig().errorPages.end())
+    // A streamed body is already on its way: its status cannot get an error page
+    if (!_response->hasStreamBody()
+        && _server->getConfig().errorPages.find(_response->getStatusCode()) !=  _server->getConfig().errorPages.end())
     {
         std::string filePath = _server->getConfig().root + _server->getConfig().errorPages.find(_response->getStatusCode())->second;
         std::ifstream file(filePath.c_str(), std::ios::binary);
@@ -48,36 +94,296 @@ void ClientConnection::prepareResponse() {
     }
 
     if (_response) {
-        _responseBuffer = _response->toString();
+        _responseHead = _response->toStringHeaders() + "\r\n";
         _responseOffset = 0;
+        _rangeIndex = 0;
+        _prefixOffset = 0;
+        _trailerOffset = 0;
+        _encoded.clear();
+        _encodedOffset = 0;
+        _streamDone = false;
+        std::string contentLength = _response->findHeader("Content-Length");
+        _streamLimited = _response->hasStreamBody() && !contentLength.empty();
+        _streamRemaining = _streamLimited ? std::strtoul(contentLength.c_str(), NULL, 10) : 0;
+        const std::vector<FileRange>& ranges = _response->getFileRanges();
+        _fileOffset = ranges.empty() ? 0 : ranges[0].offset;
+        _fileRemaining = ranges.empty() ? 0 : ranges[0].length;
         _isSending = true;
     }
 }
 
+// Kernel to socket copy of a file range, advancing offset by what was sent
+static ssize_t sendFileRange(int client_fd, int file_fd, off_t& offset, size_t count) {
+#if defined(__linux__)
+    return sendfile(client_fd, file_fd, &offset, count);
+#elif defined(__APPLE__)
+    off_t len = count;
+    int ret = sendfile(file_fd, client_fd, offset, &len, NULL, 0);
+    // A partial send is reported as EAGAIN along with the sent length
+    if (len > 0) {
+        offset += len;
+        return len;
+    }
+    return ret == -1 ? -1 : 0;
+#else
+    char buffer[65536];
+    ssize_t bytesRead = pread(file_fd, buffer, std::min(count, sizeof(buffer)), offset);
+    if (bytesRead <= 0)
+        return bytesRead;
+    ssize_t bytesSent = write(client_fd, buffer, bytesRead);
+    if (bytesSent > 0)
+        offset += bytesSent;
+    return bytesSent;
+#endif
+}
+
 int ClientConnection::sendResponseChunk(int client_fd) {
     if (!_isSending) return false;
 
-    const size_t BUFFER_SIZE = 4096;
-    char buffer[BUFFER_SIZE];
+    const std::string& body = _response->getBody();
+    size_t headSize = _responseHead.size();
+    size_t total = headSize + body.size();
+    // Bounded so that one fast client cannot monopolize the loop
+    size_t budget = SEND_BUDGET;
 
-    size_t remaining = _responseBuffer.size() - _responseOffset;
-    size_t bytesToSend = std::min(remaining, BUFFER_SIZE);
+    // Drain until the socket is full: head and body go out together, without copies
+    while (_responseOffset < total && budget > 0) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (_responseOffset < headSize) {
+            iov[iovcnt].iov_base = const_cast<char*>(_responseHead.data()) + _responseOffset;
+            iov[iovcnt].iov_len = headSize - _responseOffset;
+            ++iovcnt;
+        }
+        size_t bodyOffset = _responseOffset > headSize ? _responseOffset - headSize : 0;
+        if (bodyOffset < body.size()) {
+            iov[iovcnt].iov_base = const_cast<char*>(body.data()) + bodyOffset;
+            iov[iovcnt].iov_len = body.size() - bodyOffset;
+            ++iovcnt;
+        }
+        ssize_t bytesSent = writev(client_fd, iov, iovcnt);
+        if (bytesSent > 0) {
+            _responseOffset += bytesSent;
+            budget -= std::min(budget, static_cast<size_t>(bytesSent));
+        } else if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 1; // Socket full, resume on the next POLLOUT
+        } else {
+            _isSending = false;
+            return -1;
+        }
+    }
+    if (_responseOffset < total)
+        return 1; // Response not fully sent
 
-    std::memcpy(buffer, _responseBuffer.c_str() + _responseOffset, bytesToSend);
+    int status = sendFileBody(client_fd, budget);
+    if (status != 0) {
+        if (status == -1)
+            _isSending = false;
+        return status;
+    }
 
-    ssize_t bytesSent = write(client_fd, buffer, bytesToSend);
+    _isSending = false;
+    return 0; // Response fully sent
+}
 
-    if (bytesSent > 0) {
-        _responseOffset += bytesSent;
-        if (_responseOffset >= _responseBuffer.size()) {
-            _isSending = false;
-            return 0; // Response fully sent
+// Writes data from offset; 0 once all of it is sent, 1 to resume later, -1 on error
+static int sendBuffer(int client_fd, const std::string& data, size_t& offset, size_t& budget) {
+    while (offset < data.size()) {
+        if (budget == 0)
+            return 1;
+        ssize_t bytesSent = write(client_fd, data.data() + offset, std::min(data.size() - offset, budget));
+        if (bytesSent > 0) {
+            offset += bytesSent;
+            budget -= std::min(budget, static_cast<size_t>(bytesSent));
+        } else if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 1;
+        } else {
+            return -1;
         }
-    } else if (bytesSent == -1) {
-        _isSending = false;
-        return -1;
     }
-    return 1; // Response not fully sent
+    return 0;
+}
+
+// Appends data to out as one chunk of a chunked body
+static void appendChunk(std::string& out, const std::string& data) {
+    char size[32];
+    snprintf(size, sizeof(size), "%lx\r\n", static_cast<unsigned long>(data.size()));
+    out += size;
+    out += data;
+    out += "\r\n";
+}
+
+// Compressed file body: read and deflated a block at a time, sent as chunks
+int ClientConnection::sendEncodedFileBody(int client_fd, size_t& budget) {
+    Compressor* encoder = _response->getBodyEncoder();
+    while (true) {
+        int status = sendBuffer(client_fd, _encoded, _encodedOffset, budget);
+        if (status != 0)
+            return status;
+        if (encoder->isFinished())
+            return 0;
+        if (budget == 0)
+            return 1;
+
+        char block[65536];
+        ssize_t bytesRead = 0;
+        if (_fileRemaining > 0) {
+            bytesRead = pread(_response->getFileFd(), block, std::min(_fileRemaining, sizeof(block)), _fileOffset);
+            if (bytesRead == -1 && errno == EINTR)
+                continue;
+            if (bytesRead <= 0)
+                return -1; // Error, or the file was truncated while being sent
+            _fileOffset += bytesRead;
+            _fileRemaining -= bytesRead;
+        }
+        std::string data;
+        if (!encoder->compress(block, bytesRead, _fileRemaining == 0, data))
+            return -1;
+        _encoded.clear();
+        _encodedOffset = 0;
+        if (!data.empty())
+            appendChunk(_encoded, data);
+        if (encoder->isFinished())
+            _encoded += "0\r\n\r\n";
+    }
+}
+
+// Body produced while it is sent: forwards what arrived so far, compressed
+// and framed as chunks when the response asks for it
+int ClientConnection::sendStreamBody(int client_fd, size_t& budget) {
+    Compressor* encoder = _response->getBodyEncoder();
+    bool chunked = _response->getStrHeader("Transfer-Encoding") == "chunked";
+    while (true) {
+        int status = sendBuffer(client_fd, _encoded, _encodedOffset, budget);
+        if (status != 0)
+            return status;
+        if (_streamDone)
+            return 0;
+        if (budget == 0)
+            return 1;
+
+        std::string data;
+        _response->takeStream(data);
+        bool last = _response->isStreamEnded();
+        if (data.empty() && !last) {
+            if (_cgiHandler && _cgiHandler->isSplicing())
+                return spliceStreamBody(client_fd, budget);
+            return 1; // Resumed once the producer appended more
+        }
+        if (encoder) {
+            // The client gets each block of a streamed body as it is produced
+            std::string compressed;
+            if (!encoder->compress(data.data(), data.size(), last, compressed, true))
+                return -1;
+            data.swap(compressed);
+        }
+        _encoded.clear();
+        _encodedOffset = 0;
+        if (!chunked) {
+            if (_streamLimited && data.size() > _streamRemaining) {
+                data.resize(_streamRemaining);
+                overrunStreamBody();
+                last = true;
+            }
+            _streamRemaining -= std::min(_streamRemaining, data.size());
+            _encoded.swap(data);
+        } else {
+            if (!data.empty())
+                appendChunk(_encoded, data);
+            if (last)
+                _encoded += "0\r\n\r\n";
+        }
+        _streamDone = last;
+    }
+}
+
+// The script wrote past the Content-Length it announced: the rest would be
+// read by the client as the next response, so it is dropped with the connection
+void ClientConnection::overrunStreamBody() {
+    Logger::instance().log(WARNING, "CGI output exceeds its Content-Length, closing the connection");
+    _closeRequested = true;
+}
+
+// Script output moved from its stdout pipe to the socket inside the kernel,
+// once what was read along with its headers is sent
+int ClientConnection::spliceStreamBody(int client_fd, size_t& budget) {
+#if defined(__linux__)
+    int pipe_fd = _cgiHandler->getOutputPipeFd();
+    while (pipe_fd != -1 && _cgiHandler->isOutputReady()) {
+        if (budget == 0)
+            return 1;
+        if (_streamLimited && _streamRemaining == 0) {
+            int available = 0;
+            if (ioctl(pipe_fd, FIONREAD, &available) == 0 && available > 0) {
+                overrunStreamBody();
+                _streamDone = true;
+                return 0;
+            }
+            // Nothing more is expected: waits for the end of output
+            _cgiHandler->setOutputReady(false);
+            break;
+        }
+        size_t count = _streamLimited ? std::min(budget, _streamRemaining) : budget;
+        ssize_t moved = splice(pipe_fd, NULL, client_fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            budget -= std::min(budget, static_cast<size_t>(moved));
+            if (_streamLimited)
+                _streamRemaining -= std::min(_streamRemaining, static_cast<size_t>(moved));
+        } else if (moved == 0) {
+            // End of output, seen by the event loop once it polls the pipe again
+            _cgiHandler->setOutputReady(false);
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Either side may be the one blocking
+            int available = 0;
+            if (ioctl(pipe_fd, FIONREAD, &available) == 0 && available > 0)
+                return 1; // Socket full
+            _cgiHandler->setOutputReady(false);
+        } else {
+            return -1;
+        }
+    }
+#else
+    (void)client_fd;
+    (void)budget;
+#endif
+    return 1;
+}
+
+// File ranges, each after its in-memory prefix, then the trailer
+int ClientConnection::sendFileBody(int client_fd, size_t& budget) {
+    if (_response->hasStreamBody())
+        return sendStreamBody(client_fd, budget);
+    if (_response->getBodyEncoder())
+        return sendEncodedFileBody(client_fd, budget);
+    const std::vector<FileRange>& ranges = _response->getFileRanges();
+    while (_rangeIndex < ranges.size()) {
+        int status = sendBuffer(client_fd, ranges[_rangeIndex].prefix, _prefixOffset, budget);
+        if (status != 0)
+            return status;
+        while (_fileRemaining > 0) {
+            if (budget == 0)
+                return 1;
+            size_t count = std::min(_fileRemaining, budget);
+            ssize_t bytesSent = sendFileRange(client_fd, _response->getFileFd(), _fileOffset, count);
+            if (bytesSent > 0) {
+                _fileRemaining -= bytesSent;
+                budget -= std::min(budget, static_cast<size_t>(bytesSent));
+            } else if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                return 1; // Socket full, resume at _fileOffset on the next POLLOUT
+            } else {
+                // Error, or the file was truncated while being sent
+                return -1;
+            }
+        }
+        if (++_rangeIndex < ranges.size()) {
+            _prefixOffset = 0;
+            _fileOffset = ranges[_rangeIndex].offset;
+            _fileRemaining = ranges[_rangeIndex].length;
+        }
+    }
+    return sendBuffer(client_fd, _response->getFileTrailer(), _trailerOffset, budget);
 }
 
 void ClientConnection::resetConnection() {
@@ -93,7 +399,12 @@ void ClientConnection::resetConnection() {
         delete _cgiHandler;
         _cgiHandler = NULL;
     }
+    _cgiQueue = NULL;
+    _cgiCache = NULL;
     _responseOffset = 0;
+    _encoded.clear();
+    _location = NULL;
+    _acceptEncoding.clear();
     _isSending = false;
     _exchangeOver = false;
     _used = true;
@@ -104,3 +415,15 @@ bool ClientConnection::isResponseComplete() const {
     return !_isSending;
 }
 
+size_t ClientConnection::getStreamBacklog() const {
+    if (!_response || !_response->hasStreamBody())
+        return 0;
+    return _response->getStreamSize() + _encoded.size() - _encodedOffset;
+}
+
+bool ClientConnection::isStreamStarved() const {
+    bool spliceReady = _cgiHandler && _cgiHandler->isSplicing() && _cgiHandler->isOutputReady();
+    return _isSending && _response->hasStreamBody() && !_response->isStreamEnded()
+        && _responseOffset >= _responseHead.size() && getStreamBacklog() == 0 && !spliceReady;
+}
+
@@ -4,24 +4,68 @@
 
 #include <string>
 
+#include <sys/types.h>
+
+#include "TimerWheel.hpp"
+
 class Server;
 class HTTPRequest;
 class HTTPResponse;
 class CGIHandler;
+class CGIQueue;
+class CGICache;
+struct Location;
 
 class ClientConnection {
 private:
+    // Bytes sent per POLLOUT event
+    static const size_t SEND_BUDGET = 4 * 1024 * 1024;
+
     Server* _server;
     HTTPRequest* _request;
     HTTPResponse* _response;
     CGIHandler* _cgiHandler;
+    // Queue the request waits in for a CGI slot, NULL once started
+    CGIQueue* _cgiQueue;
+    // Cache whose running script the request waits for, NULL otherwise
+    CGICache* _cgiCache;
 
-    std::string _responseBuffer;
+    // Status line and headers; the body is sent from the response itself
+    std::string _responseHead;
+    // Progress over head + in-memory body
     size_t _responseOffset;
+    // Progress in the file body, if the response has one: current range,
+    // bytes of its prefix already sent, position in the file, then trailer
+    size_t _rangeIndex;
+    size_t _prefixOffset;
+    off_t _fileOffset;
+    size_t _fileRemaining;
+    size_t _trailerOffset;
+    // Compressed file body block, or streamed body data, being sent
+    std::string _encoded;
+    size_t _encodedOffset;
+    // The last block of a streamed body has been queued
+    bool _streamDone;
+    // Identity stream with a Content-Length from the script: what is left of it
+    bool _streamLimited;
+    size_t _streamRemaining;
+    // Captured before the request is released, for responses completed later (CGI)
+    const Location* _location;
+    std::string _acceptEncoding;
     bool _isSending;
     bool _exchangeOver;
     bool _used;
+    bool _closeRequested;
+    // Bytes received past the end of the current request (pipelining)
+    std::string _inputBuffer;
+    // Deadline of the current phase (read, keep-alive, send or CGI)
+    Timer _timer;
 
+    int sendFileBody(int client_fd, size_t& budget);
+    int sendEncodedFileBody(int client_fd, size_t& budget);
+    int sendStreamBody(int client_fd, size_t& budget);
+    int spliceStreamBody(int client_fd, size_t& budget);
+    void overrunStreamBody();
 
 public:
     ClientConnection(Server* server);
@@ -31,18 +75,36 @@ public:
     HTTPRequest* getRequest() const;
     HTTPResponse* getResponse() const;
     CGIHandler* getCgiHandler() const;
+    CGIQueue* getCgiQueue() const;
+    CGICache* getCgiCache() const;
     bool getExchangeOver() const;   
     bool getUsed() const;
+    Timer& getTimer();
+    bool getCloseRequested() const;
+    bool hasBufferedInput() const;
+    const Location* getLocation() const;
+    const std::string& getAcceptEncoding() const;
 
     void setExchangeOver(bool value);
     void setCgiHandler(CGIHandler* cgiHandler);
+    void setCgiQueue(CGIQueue* queue);
+    void setCgiCache(CGICache* cache);
     void setRequest(HTTPRequest* request);
     void setResponse(HTTPResponse* response);
     void setRequestActivity(unsigned long time);
+    void setCloseRequested(bool value);
+    void setEncodingContext(const Location* location, const std::string& acceptEncoding);
+
+    void bufferInput(const char* data, size_t len);
+    void takeBufferedInput(std::string& input);
 
     void prepareResponse();
     int sendResponseChunk(int client_fd);
     bool isResponseComplete() const;
+    // Streamed body bytes received but not written to the socket yet
+    size_t getStreamBacklog() const;
+    // Everything received so far is sent, more is still to come
+    bool isStreamStarved() const;
     void resetConnection();
 
 };
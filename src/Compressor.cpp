@@ -0,0 +1,50 @@
+// Compressor.cpp
+#include "Compressor.hpp"
+
+#include <cstring>
+
+Compressor::Compressor(Format format) : _valid(false), _finished(false) {
+    std::memset(&_stream, 0, sizeof(_stream));
+    // 15 bits window, +16 for the gzip header and trailer
+    int windowBits = format == GZIP ? 15 + 16 : 15;
+    _valid = deflateInit2(&_stream, LEVEL, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Compressor::~Compressor() {
+    if (_valid)
+        deflateEnd(&_stream);
+}
+
+bool Compressor::compress(const char* data, size_t len, bool finish, std::string& out, bool sync) {
+    if (!_valid || _finished)
+        return false;
+    _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    _stream.avail_in = static_cast<uInt>(len);
+    int flush = finish ? Z_FINISH : sync ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+    char buffer[16384];
+    int ret;
+    do {
+        _stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        _stream.avail_out = sizeof(buffer);
+        ret = deflate(&_stream, flush);
+        if (ret == Z_STREAM_ERROR)
+            return false;
+        out.append(buffer, sizeof(buffer) - _stream.avail_out);
+    } while (_stream.avail_out == 0 || (finish && ret != Z_STREAM_END));
+    if (finish)
+        _finished = true;
+    return true;
+}
+
+bool Compressor::isFinished() const { return _finished; }
+
+bool Compressor::compressAll(Format format, const std::string& in, std::string& out) {
+    Compressor compressor(format);
+    out.clear();
+    out.reserve(in.size() / 3);
+    return compressor.compress(in.data(), in.size(), true, out);
+}
+
+const char* Compressor::name(Format format) {
+    return format == GZIP ? "gzip" : "deflate";
+}
@@ -0,0 +1,38 @@
+// Compressor.hpp
+#ifndef COMPRESSOR_HPP
+#define COMPRESSOR_HPP
+
+#include <string>
+#include <cstddef>
+
+#include <zlib.h>
+
+// Streaming gzip / deflate (zlib format, as HTTP defines it) encoder
+class Compressor {
+public:
+    enum Format { GZIP, DEFLATE };
+
+    static const int LEVEL = 6;
+
+    Compressor(Format format);
+    ~Compressor();
+
+    // Appends the compressed form of data to out; finish ends the stream,
+    // sync emits everything compressed so far instead of waiting for a full block
+    bool compress(const char* data, size_t len, bool finish, std::string& out, bool sync = false);
+    bool isFinished() const;
+
+    static bool compressAll(Format format, const std::string& in, std::string& out);
+    // Content-Encoding value
+    static const char* name(Format format);
+
+private:
+    z_stream _stream;
+    bool _valid;
+    bool _finished;
+
+    Compressor(const Compressor&);
+    Compressor& operator=(const Compressor&);
+};
+
+#endif
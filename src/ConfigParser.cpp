@@ -3,6 +3,7 @@
 
 #include "ServerConfig.hpp"
 #include "Logger.hpp"
+#include "FastCGIPool.hpp"
 
 #include <fstream>
 #include <sstream>
@@ -10,6 +11,7 @@
 #include <algorithm>
 
 #include <cctype>
+#include <cstdlib>
 
 ConfigParser::ConfigParser() {}
 
@@ -50,6 +52,8 @@ void ConfigParser::parseConfigFile(const std::string &filename) {
                 processServerDirective(file, line, serverConfig);
             }
             _serverConfigs.push_back(serverConfig);
+        } else if (line[line.size() - 1] == ';') {
+            processGlobalDirective(line);
         } else {
             throw ConfigParserException("Unknown or unexpected directive: \"" + line + "\"");
         }
@@ -60,6 +64,36 @@ const std::vector<ServerConfig>& ConfigParser::getServerConfigs() const {
     return _serverConfigs;
 }
 
+const GlobalConfig& ConfigParser::getGlobalConfig() const {
+    return _globalConfig;
+}
+
+void ConfigParser::processGlobalDirective(const std::string &line) {
+    std::istringstream iss(line);
+    std::string directive;
+    iss >> directive;
+
+    std::string value;
+    std::getline(iss, value, ';');
+    trim(value);
+
+    if (directive == "event_backend") {
+        validateDirectiveValue(directive, value);
+        _globalConfig.eventBackend = value;
+        Logger::instance().log(DEBUG, "Set event_backend to " + value);
+    } else if (directive == "worker_processes") {
+        validateDirectiveValue(directive, value);
+        _globalConfig.workerProcesses = (value == "auto") ? 0 : std::atoi(value.c_str());
+        Logger::instance().log(DEBUG, "Set worker_processes to " + value);
+    } else if (directive == "cgi_spawn_helpers") {
+        validateDirectiveValue(directive, value);
+        _globalConfig.cgiSpawnHelpers = std::atoi(value.c_str());
+        Logger::instance().log(DEBUG, "Set cgi_spawn_helpers to " + value);
+    } else {
+        throw ConfigParserException("Unknown or unexpected directive: \"" + line + "\"");
+    }
+}
+
 void ConfigParser::validateDirectiveValue(const std::string &directive, const std::string &value) {
     if (directive == "listen") {
         size_t colonPos = value.find(':');
@@ -119,6 +153,27 @@ void ConfigParser::validateDirectiveValue(const std::string &directive, const st
     	if (maxSize < 0) {
         	throw ConfigParserException("Invalid value for 'client_max_body_size': " + value);
     	}
+	} else if (directive == "file_cache_size" || directive == "file_cache_max_file"
+			|| directive == "file_cache_valid" || directive == "open_file_cache"
+			|| directive == "gzip_min_length" || directive == "fastcgi_keepalive"
+			|| directive == "cgi_max_concurrency" || directive == "cgi_queue_size"
+			|| directive == "cgi_cache_valid" || directive == "cgi_cache_stale" || directive == "cgi_cache_size") {
+		if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+			throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+		}
+	} else if (directive == "gzip" || directive == "precompressed" || directive == "cgi_cache"
+			|| directive == "cgi_cache_lock") {
+		if (value != "on" && value != "off") {
+			throw ConfigParserException("Invalid value for '" + directive + "': " + value);
+		}
+	} else if (directive == "gzip_types") {
+		if (value.empty()) {
+			throw ConfigParserException("Invalid value for 'gzip_types': " + value);
+		}
+	} else if (directive == "fastcgi_pass") {
+		if (!FastCGIPool::isValidAddress(value)) {
+			throw ConfigParserException("Invalid value for 'fastcgi_pass': " + value);
+		}
 	} else if (directive == "upload_on") {
         if (value != "on" && value != "off") {
             throw ConfigParserException("Invalid value for 'upload_on': " + value);
@@ -131,6 +186,20 @@ void ConfigParser::validateDirectiveValue(const std::string &directive, const st
         if (value.empty()) {
             throw ConfigParserException("Invalid CGI interpreter path: " + value);
         }
+    } else if (directive == "event_backend") {
+        if (value != "epoll" && value != "poll") {
+            throw ConfigParserException("Invalid value for 'event_backend': " + value);
+        }
+    } else if (directive == "worker_processes") {
+        if (value != "auto" && (value.empty() || value.find_first_not_of("0123456789") != std::string::npos
+                || std::atoi(value.c_str()) < 1 || std::atoi(value.c_str()) > 512)) {
+            throw ConfigParserException("Invalid value for 'worker_processes': " + value);
+        }
+    } else if (directive == "cgi_spawn_helpers") {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos
+                || std::atoi(value.c_str()) > 64) {
+            throw ConfigParserException("Invalid value for 'cgi_spawn_helpers': " + value);
+        }
     }
 
 }
@@ -236,6 +305,26 @@ void ConfigParser::processServerDirective(std::ifstream &file, const std::string
     		validateDirectiveValue(directive, value);
     		serverConfig.autoindex = (value == "on");
     		Logger::instance().log(DEBUG, "Set autoindex to " + value + " in server config");
+		} else if (directive == "file_cache_size") {
+			validateDirectiveValue(directive, value);
+			serverConfig.fileCacheSize = std::strtoul(value.c_str(), NULL, 10);
+			Logger::instance().log(DEBUG, "Set file_cache_size to " + value + " in server config");
+		} else if (directive == "file_cache_max_file") {
+			validateDirectiveValue(directive, value);
+			serverConfig.fileCacheMaxFile = std::strtoul(value.c_str(), NULL, 10);
+			Logger::instance().log(DEBUG, "Set file_cache_max_file to " + value + " in server config");
+		} else if (directive == "file_cache_valid") {
+			validateDirectiveValue(directive, value);
+			serverConfig.fileCacheValidMs = std::strtoul(value.c_str(), NULL, 10) * 1000;
+			Logger::instance().log(DEBUG, "Set file_cache_valid to " + value + "s in server config");
+		} else if (directive == "open_file_cache") {
+			validateDirectiveValue(directive, value);
+			serverConfig.openFileCacheMax = std::strtoul(value.c_str(), NULL, 10);
+			Logger::instance().log(DEBUG, "Set open_file_cache to " + value + " in server config");
+		} else if (directive == "fastcgi_keepalive") {
+			validateDirectiveValue(directive, value);
+			serverConfig.fastcgiKeepalive = std::strtoul(value.c_str(), NULL, 10);
+			Logger::instance().log(DEBUG, "Set fastcgi_keepalive to " + value + " in server config");
 	} else if (directive == "cgi_interpreter") {
         std::istringstream valueStream(value);
         std::string extension, interpreterPath;
@@ -330,6 +419,46 @@ void ConfigParser::processLocationBlock(std::ifstream &file, const std::string&
                 validateDirectiveValue(directive, value);
                 location.autoindex = (value == "on");
                 Logger::instance().log(DEBUG, "Set autoindex to " + value + " in location " + location.path);
+            } else if (directive == "gzip") {
+                location.gzip = (value == "on");
+                Logger::instance().log(DEBUG, "Set gzip to " + value + " in location " + location.path);
+            } else if (directive == "gzip_types") {
+                std::istringstream valueStream(value);
+                std::string type;
+                location.gzipTypes.clear();
+                while (valueStream >> type)
+                    location.gzipTypes.push_back(type);
+                Logger::instance().log(DEBUG, "Set gzip_types to " + value + " in location " + location.path);
+            } else if (directive == "precompressed") {
+                location.precompressed = (value == "on");
+                Logger::instance().log(DEBUG, "Set precompressed to " + value + " in location " + location.path);
+            } else if (directive == "gzip_min_length") {
+                location.gzipMinLength = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set gzip_min_length to " + value + " in location " + location.path);
+            } else if (directive == "cgi_max_concurrency") {
+                location.cgiMaxConcurrency = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set cgi_max_concurrency to " + value + " in location " + location.path);
+            } else if (directive == "cgi_queue_size") {
+                location.cgiQueueSize = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set cgi_queue_size to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache") {
+                location.cgiCache = (value == "on");
+                Logger::instance().log(DEBUG, "Set cgi_cache to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_lock") {
+                location.cgiCacheLock = (value == "on");
+                Logger::instance().log(DEBUG, "Set cgi_cache_lock to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_valid") {
+                location.cgiCacheValid = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set cgi_cache_valid to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_stale") {
+                location.cgiCacheStale = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set cgi_cache_stale to " + value + " in location " + location.path);
+            } else if (directive == "cgi_cache_size") {
+                location.cgiCacheSize = std::strtoul(value.c_str(), NULL, 10);
+                Logger::instance().log(DEBUG, "Set cgi_cache_size to " + value + " in location " + location.path);
+            } else if (directive == "fastcgi_pass") {
+                location.fastcgiPass = value;
+                Logger::instance().log(DEBUG, "Set fastcgi_pass to " + value + " in location " + location.path);
             } if (directive == "cgi_interpreter") {
 				std::istringstream valueStream(value);
         		std::string extension, interpreterPath;
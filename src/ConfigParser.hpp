@@ -3,6 +3,7 @@
 #define CONFIGPARSER_HPP
 
 #include "ServerConfig.hpp"
+#include "GlobalConfig.hpp"
 #include "Logger.hpp"
 
 #include <stdexcept>
@@ -30,9 +31,13 @@ public:
     void parseConfigFile(const std::string &filename);
 
     const std::vector<ServerConfig>& getServerConfigs() const;
+    const GlobalConfig& getGlobalConfig() const;
 
 private:
     std::vector<ServerConfig> _serverConfigs;
+    GlobalConfig _globalConfig;
+
+    void processGlobalDirective(const std::string &line);
 
     void processServerDirective(std::ifstream &file, const std::string &line, ServerConfig &serverConfig);
 
@@ -0,0 +1,104 @@
+// EpollPoller.cpp
+#ifdef __linux__
+
+#include "EpollPoller.hpp"
+
+#include "Logger.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#define EPOLL_MIN_EVENTS 64
+#define EPOLL_MAX_EVENTS 1024
+
+EpollPoller::EpollPoller() : _epollFd(-1), _events(EPOLL_MIN_EVENTS) {
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd == -1)
+        Logger::instance().log(ERROR, std::string("epoll_create1 failed: ") + strerror(errno));
+}
+
+EpollPoller::~EpollPoller() {
+    if (_epollFd != -1)
+        close(_epollFd);
+}
+
+bool EpollPoller::isValid() const { return _epollFd != -1; }
+
+const char* EpollPoller::name() const { return "epoll"; }
+
+unsigned int EpollPoller::toEpoll(short events) {
+    unsigned int result = 0;
+    if (events & POLLIN)
+        result |= EPOLLIN;
+    if (events & POLLOUT)
+        result |= EPOLLOUT;
+    return result;
+}
+
+short EpollPoller::fromEpoll(unsigned int events) {
+    short result = 0;
+    if (events & EPOLLIN)
+        result |= POLLIN;
+    if (events & EPOLLOUT)
+        result |= POLLOUT;
+    if (events & EPOLLHUP)
+        result |= POLLHUP;
+    if (events & EPOLLERR)
+        result |= POLLERR;
+    return result;
+}
+
+bool EpollPoller::registerFd(int fd, short events) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        Logger::instance().log(ERROR, "epoll_ctl(ADD) failed for fd " + to_string(fd) + ": " + strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool EpollPoller::updateFd(int fd, short events) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+        Logger::instance().log(ERROR, "epoll_ctl(MOD) failed for fd " + to_string(fd) + ": " + strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void EpollPoller::unregisterFd(int fd) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    // A closed fd has already left the epoll set, EBADF/ENOENT are expected then
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollPoller::wait(std::vector<PollerEvent>& ready, int timeout_ms) {
+    ready.clear();
+    size_t wanted = size() < EPOLL_MIN_EVENTS ? EPOLL_MIN_EVENTS : size();
+    if (wanted > EPOLL_MAX_EVENTS)
+        wanted = EPOLL_MAX_EVENTS;
+    if (_events.size() != wanted)
+        _events.resize(wanted);
+
+    int count = epoll_wait(_epollFd, &_events[0], _events.size(), timeout_ms);
+    if (count <= 0)
+        return count;
+    for (int i = 0; i < count; ++i) {
+        PollerEvent event;
+        event.fd = _events[i].data.fd;
+        event.revents = fromEpoll(_events[i].events);
+        ready.push_back(event);
+    }
+    return count;
+}
+
+#endif // __linux__
@@ -0,0 +1,39 @@
+// EpollPoller.hpp
+#ifndef EPOLLPOLLER_HPP
+#define EPOLLPOLLER_HPP
+
+#ifdef __linux__
+
+#include "Poller.hpp"
+
+#include <vector>
+
+#include <sys/epoll.h>
+
+// Linux backend: the kernel keeps the interest list and only returns ready fds
+class EpollPoller : public Poller {
+public:
+    EpollPoller();
+    virtual ~EpollPoller();
+
+    bool isValid() const;
+
+    virtual int wait(std::vector<PollerEvent>& ready, int timeout_ms);
+    virtual const char* name() const;
+
+protected:
+    virtual bool registerFd(int fd, short events);
+    virtual bool updateFd(int fd, short events);
+    virtual void unregisterFd(int fd);
+
+private:
+    int _epollFd;
+    std::vector<epoll_event> _events;
+
+    static unsigned int toEpoll(short events);
+    static short fromEpoll(unsigned int events);
+};
+
+#endif // __linux__
+
+#endif
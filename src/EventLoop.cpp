@@ -0,0 +1,783 @@
+// EventLoop.cpp
+#include "EventLoop.hpp"
+
+#include "Server.hpp"
+#include "CGIHandler.hpp"
+#include "CGIQueue.hpp"
+#include "CGICache.hpp"
+#include "HTTPRequest.hpp"
+#include "HTTPResponse.hpp"
+#include "Logger.hpp"
+
+#include <cstdio>
+#include <cerrno>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+EventLoop::EventLoop(Poller* poller) : _poller(poller), _timers(curr_time_ms()), _spawner(NULL), _stopServer(false) {
+    Logger::instance().log(INFO, std::string("Event loop using ") + _poller->name() + " backend");
+}
+
+EventLoop::~EventLoop() {
+    closeConnections();
+    delete _poller;
+}
+
+void EventLoop::closeConnections() {
+    for (std::map<int, ClientConnection>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        it->second.resetConnection();
+        close(it->first);
+    }
+    _connections.clear();
+}
+
+void EventLoop::addListener(int fd, Server* server) {
+    _servers.insert(server);
+    _registry.registerListener(fd, server);
+    _poller->add(fd, POLLIN);
+}
+
+void EventLoop::addSignalPipe(int fd) {
+    _registry.registerSignalPipe(fd);
+    _poller->add(fd, POLLIN);
+}
+
+void EventLoop::addSpawner(CGISpawner* spawner) {
+    _spawner = spawner;
+    _registry.registerSpawnStatus(spawner->getStatusFd());
+    _poller->add(spawner->getStatusFd(), POLLIN);
+}
+
+void EventLoop::watchCgiPipe(int fd, FDType type, short events, int client_fd, ClientConnection& connection) {
+    if (fd == -1)
+        return;
+    _registry.registerCgiPipe(fd, type, client_fd, &connection);
+    _poller->add(fd, events);
+}
+
+// A FastCGI socket carries the reply too: only stop writing to it
+void EventLoop::closeCgiInput(CGIHandler* cgiHandler) {
+    int fd = cgiHandler->getInputPipeFd();
+    if (cgiHandler->isFastCGI() && fd != -1)
+        _poller->disable(fd, POLLOUT);
+    else
+        unwatch(fd);
+    cgiHandler->closeInputPipe();
+}
+
+// Unwatch before closing: the children still share the pipe, so close()
+// alone would leave it registered in epoll, and a pooled FastCGI socket
+// must not report events while idle
+void EventLoop::closeCgiOutput(CGIHandler* cgiHandler) {
+    unwatch(cgiHandler->getOutputPipeFd());
+    cgiHandler->closeOutputPipe();
+}
+
+void EventLoop::unwatch(int fd) {
+    if (fd == -1)
+        return;
+    _poller->remove(fd);
+    _registry.unregister(fd);
+    _dropped.insert(fd);
+}
+
+void EventLoop::closeConnection(int client_fd) {
+    std::map<int, ClientConnection>::iterator it = _connections.find(client_fd);
+    if (it != _connections.end()) {
+        CGIHandler* cgiHandler = it->second.getCgiHandler();
+        if (cgiHandler) {
+            unwatch(cgiHandler->getInputPipeFd());
+            unwatch(cgiHandler->getOutputPipeFd());
+            // Nobody is left to read the answer
+            _cgiPids.erase(cgiHandler->getPid());
+            cgiHandler->terminateCGI();
+        }
+        if (it->second.getCgiQueue())
+            it->second.getCgiQueue()->cancel(client_fd);
+        if (it->second.getCgiCache())
+            it->second.getCgiCache()->cancel(client_fd);
+        it->second.resetConnection();
+        _connections.erase(it);
+    }
+    unwatch(client_fd);
+    close(client_fd);
+}
+
+void EventLoop::manageConnections() {
+    if (_pending.empty())
+        return;
+    // Only connections that saw an event since the last pass can change state
+    std::set<int> pending;
+    pending.swap(_pending);
+    for (std::set<int>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        std::map<int, ClientConnection>::iterator it_conn = _connections.find(*it);
+        if (it_conn == _connections.end())
+            continue;
+        if (updateConnection(it_conn->first, it_conn->second))
+            refreshTimer(it_conn->first, it_conn->second);
+    }
+}
+
+// Returns false once the connection has been closed
+bool EventLoop::updateConnection(int client_fd, ClientConnection& connection) {
+    if (connection.getRequest() && connection.getRequest()->getConnectionClosed()) {
+        closeConnection(client_fd);
+        return false;
+    }
+
+    // Waiting for a CGI slot: only the head of the queue is handled again
+    if (connection.getCgiQueue() && connection.getCgiQueue()->nextReady() != client_fd)
+        return true;
+    // Waiting for the response of an identical request
+    if (connection.getCgiCache() && connection.getCgiCache()->isWaiting(client_fd))
+        return true;
+
+    if (connection.getExchangeOver()) {
+        if (connection.getCloseRequested()) {
+            closeConnection(client_fd);
+            return false;
+        }
+        connection.resetConnection();
+        _poller->modify(client_fd, POLLIN);
+        // Requests pipelined behind the one just answered are served before reading again
+        if (connection.hasBufferedInput())
+            connection.getServer()->handlePipelinedRequest(connection);
+    }
+
+    HTTPRequest* request = connection.getRequest();
+
+    // Child exits are delivered through SIGCHLD, see reapChildren()
+    if (connection.getCgiHandler())
+        return updateCgiFlow(client_fd, connection);
+
+    // One request at a time: stop reading until its response is sent, so
+    // responses go out in request order and pipelined bytes wait in the socket
+    if (connection.getResponse() != NULL) {
+        // A streamed body with nothing left to send waits for the script
+        _poller->modify(client_fd, connection.isStreamStarved() ? 0 : POLLOUT);
+        return true;
+    }
+
+    if (request && request->getErrorCode() != 0) {
+        closeConnection(client_fd);
+        return false;
+    }
+
+    if (request && (request->isComplete() || connection.getServer()->streamsRequestBody(*request))) {
+        Logger::instance().log(INFO, "Parsing OK, handling request for client fd: " + to_string(client_fd));
+        bool bodyPending = !request->isComplete();
+        connection.getServer()->handleHttpRequest(client_fd, connection);
+        if (connection.getResponse() != NULL) {
+            // Answered before its body arrived: the rest of the stream cannot be framed
+            if (bodyPending)
+                connection.getResponse()->setHeader("Connection", "close");
+            connection.prepareResponse();
+            _poller->modify(client_fd, POLLOUT);
+        } else if (connection.getCgiHandler() && connection.getCgiHandler()->isFastCGI()) {
+            // Request and reply share the socket, written first while connecting
+            watchCgiPipe(connection.getCgiHandler()->getOutputPipeFd(), FD_FASTCGI, POLLIN | POLLOUT, client_fd, connection);
+            return updateCgiFlow(client_fd, connection);
+        } else if (connection.getCgiHandler()) {
+            _cgiPids[connection.getCgiHandler()->getPid()] = client_fd;
+            int cgi_input_fd = connection.getCgiHandler()->getInputPipeFd();
+            if (cgi_input_fd != -1) {
+                watchCgiPipe(cgi_input_fd, FD_CGI_INPUT, POLLOUT, client_fd, connection);
+                // Read while writing: a script echoing its input would otherwise fill
+                // its stdout pipe and stop reading stdin
+                watchCgiPipe(connection.getCgiHandler()->getOutputPipeFd(), FD_CGI_OUTPUT, POLLIN, client_fd, connection);
+                return updateCgiFlow(client_fd, connection);
+            }
+        } else if (connection.getCgiQueue() || connection.getCgiCache()) {
+            // Queued: the rest of the body stays in the socket until the script starts
+            _poller->modify(client_fd, 0);
+        } else {
+            Logger::instance().log(ERROR, "No response or CGI handler after handleHttpRequest");
+        }
+    }
+    return true;
+}
+
+void EventLoop::armTimer(int client_fd, ClientConnection& connection, TimerKind kind, unsigned long deadline) {
+    Timer& timer = connection.getTimer();
+    timer.fd = client_fd;
+    timer.kind = kind;
+    _timers.arm(timer, deadline);
+}
+
+// Picks the deadline matching the phase the connection is in
+void EventLoop::refreshTimer(int client_fd, ClientConnection& connection) {
+    Timer& timer = connection.getTimer();
+    HTTPRequest* request = connection.getRequest();
+    unsigned long now = curr_time_ms();
+
+    if (connection.getCgiHandler() && (connection.getResponse() || (request && !request->isComplete()))) {
+        // Body or output being streamed: either the script or the client must make progress
+        armTimer(client_fd, connection, TIMER_CGI, now + CGIHandler::CGI_TIMEOUT_MS);
+    } else if (connection.getCgiHandler()) {
+        // Counted from the start of the script, not from the last pipe activity
+        if (!timer.isArmed() || timer.kind != TIMER_CGI)
+            armTimer(client_fd, connection, TIMER_CGI, now + CGIHandler::CGI_TIMEOUT_MS);
+    } else if (connection.getCgiQueue() || connection.getCgiCache()) {
+        // Time spent waiting counts against the CGI timeout
+        if (!timer.isArmed() || timer.kind != TIMER_CGI)
+            armTimer(client_fd, connection, TIMER_CGI, now + CGIHandler::CGI_TIMEOUT_MS);
+    } else if (connection.getResponse()) {
+        armTimer(client_fd, connection, TIMER_SEND, now + SEND_TIMEOUT_MS);
+    } else if (request && request->getHeadersParsed()) {
+        armTimer(client_fd, connection, TIMER_BODY_READ, now + TIMEOUT_MS);
+    } else if (request || !connection.getUsed()) {
+        armTimer(client_fd, connection, TIMER_HEADER_READ, now + TIMEOUT_MS);
+    } else if (!timer.isArmed() || timer.kind != TIMER_KEEPALIVE) {
+        armTimer(client_fd, connection, TIMER_KEEPALIVE, now + KEEPALIVE_TIMEOUT_MS);
+    }
+}
+
+void EventLoop::expireTimers() {
+    std::vector<Timer*> expired;
+    _timers.advance(curr_time_ms(), expired);
+    // Copied first: handling a timeout may destroy the connection owning the timer
+    std::vector<std::pair<int, TimerKind> > fired;
+    for (size_t i = 0; i < expired.size(); ++i)
+        fired.push_back(std::make_pair(expired[i]->fd, expired[i]->kind));
+
+    for (size_t i = 0; i < fired.size(); ++i) {
+        std::map<int, ClientConnection>::iterator it = _connections.find(fired[i].first);
+        if (it == _connections.end())
+            continue;
+        handleTimeout(fired[i].first, it->second, fired[i].second);
+        it = _connections.find(fired[i].first);
+        if (it != _connections.end())
+            refreshTimer(it->first, it->second);
+    }
+}
+
+void EventLoop::handleTimeout(int client_fd, ClientConnection& connection, TimerKind kind) {
+    HTTPRequest* request = connection.getRequest();
+
+    switch (kind) {
+    case TIMER_HEADER_READ:
+    case TIMER_BODY_READ:
+        if (!request) {
+            Logger::instance().log(INFO, "No request received, closing client FD: " + to_string(client_fd));
+            closeConnection(client_fd);
+            return;
+        }
+        Logger::instance().log(INFO, "Connection timed out for client FD: " + to_string(client_fd));
+        {
+            HTTPResponse* timeoutResponse = new HTTPResponse();
+            timeoutResponse->beError(408); // Request Timeout
+            timeoutResponse->setHeader("Connection", "close");
+            if (connection.getResponse())
+                delete connection.getResponse();
+            connection.setResponse(timeoutResponse);
+            connection.prepareResponse();
+            _poller->modify(client_fd, POLLOUT);
+            request->setLastActivity(curr_time_ms());
+        }
+        break;
+    case TIMER_KEEPALIVE:
+        Logger::instance().log(INFO, "Keep-alive timeout, closing client FD: " + to_string(client_fd));
+        closeConnection(client_fd);
+        break;
+    case TIMER_SEND:
+        Logger::instance().log(INFO, "Client stopped reading, closing client FD: " + to_string(client_fd));
+        closeConnection(client_fd);
+        break;
+    case TIMER_CGI:
+        if (connection.getCgiHandler() && connection.getResponse()) {
+            // Part of the response is already sent, an error can no longer replace it
+            Logger::instance().log(INFO, "CGI output stalled, closing client FD: " + to_string(client_fd));
+            closeConnection(client_fd);
+        } else if (connection.getCgiHandler()) {
+            HTTPResponse* cgiResponse = new HTTPResponse();
+            cgiResponse->beError(504, "CGI script timed out");
+            cgiResponse->setHeader("Connection", "close");
+            abortCgi(connection, client_fd, cgiResponse);
+        } else if (connection.getCgiQueue()) {
+            Logger::instance().log(INFO, "No CGI slot freed in time for client FD: " + to_string(client_fd));
+            connection.getCgiQueue()->cancel(client_fd);
+            connection.setCgiQueue(NULL);
+            HTTPResponse* queueResponse = new HTTPResponse();
+            queueResponse->beError(503, "Too many CGI requests");
+            queueResponse->setHeader("Retry-After", to_string(CGIQueue::RETRY_AFTER_SECONDS));
+            queueResponse->setHeader("Connection", "close");
+            connection.setResponse(queueResponse);
+            connection.prepareResponse();
+            _poller->modify(client_fd, POLLOUT);
+        } else if (connection.getCgiCache()) {
+            Logger::instance().log(INFO, "Identical CGI request timed out, client FD: " + to_string(client_fd));
+            connection.getCgiCache()->cancel(client_fd);
+            connection.setCgiCache(NULL);
+            HTTPResponse* cgiResponse = new HTTPResponse();
+            cgiResponse->beError(504, "CGI script timed out");
+            cgiResponse->setHeader("Connection", "close");
+            connection.setResponse(cgiResponse);
+            connection.prepareResponse();
+            _poller->modify(client_fd, POLLOUT);
+        }
+        break;
+    }
+}
+
+void EventLoop::run() {
+    while (!_stopServer) {
+
+        manageConnections();
+        expireTimers();
+        // Slots freed by the last pass start the requests waiting for them
+        for (std::set<Server*>::iterator it = _servers.begin(); it != _servers.end(); ++it)
+            (*it)->collectCgiReady(_pending);
+        int timeout = _pending.empty() ? _timers.nextTimeout(curr_time_ms()) : 0;
+
+        int count = _poller->wait(_ready, timeout);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                // wait() a été interrompu par un signal, continuer la boucle
+                continue;
+            } else {
+                perror("Error waiting for events");
+                break;
+            }
+        }
+
+        _dropped.clear();
+        for (size_t i = 0; i < _ready.size() && !_stopServer; ++i) {
+            // The fd may have been dropped while handling a previous event of this batch
+            if (_dropped.count(_ready[i].fd) || _registry.getType(_ready[i].fd) == FD_UNKNOWN)
+                continue;
+            handleEvent(_ready[i].fd, _ready[i].revents);
+        }
+    }
+}
+
+void EventLoop::handleSignal(short revents) {
+    if (revents & POLLIN) {
+        // Vider le pipe: plusieurs signaux peuvent être en attente
+        char bytes[64];
+        ssize_t bytesRead = read(serverSignal::pipe_fd[0], bytes, sizeof(bytes));
+        bool childExited = false;
+        for (ssize_t i = 0; i < bytesRead; ++i) {
+            if (bytes[i] == SIGCHLD) {
+                childExited = true;
+            } else if (bytes[i] == SIGINT || bytes[i] == SIGTERM) {
+                Logger::instance().log(INFO, "Signal received, stopping the server...");
+                _stopServer = true;
+            }
+        }
+        if (childExited)
+            reapChildren();
+    }
+}
+
+void EventLoop::reapChildren() {
+    int status;
+    pid_t pid;
+    // Spawn helpers are reaped here too, they are not in _cgiPids
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        childExited(pid, status);
+}
+
+// Scripts forked by a spawn helper are its children: it reaps them and
+// reports their status
+void EventLoop::handleSpawnStatus(int fd, short revents) {
+    pid_t pid;
+    int status;
+    while (_spawner->readStatus(pid, status))
+        childExited(pid, status);
+    // No helper left, scripts are forked by the worker again
+    if (revents & (POLLHUP | POLLERR))
+        unwatch(fd);
+}
+
+void EventLoop::childExited(pid_t pid, int status) {
+    std::map<pid_t, int>::iterator it = _cgiPids.find(pid);
+    if (it == _cgiPids.end())
+        return;
+    int client_fd = it->second;
+    _cgiPids.erase(it);
+
+    std::map<int, ClientConnection>::iterator conn_it = _connections.find(client_fd);
+    if (conn_it == _connections.end())
+        return;
+    ClientConnection& connection = conn_it->second;
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    if (!cgiHandler || cgiHandler->getPid() != pid)
+        return;
+
+    cgiHandler->setExitStatus(status);
+    Logger::instance().log(DEBUG, "CGI process " + to_string(pid) + " exited with status " + to_string(cgiHandler->isCgiDone()));
+    finishCgi(connection, client_fd);
+}
+
+void EventLoop::finishCgi(ClientConnection& connection, int client_fd) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    // The response is built once both the output EOF and the exit status are known
+    if (cgiHandler->getOutputPipeFd() != -1 || !cgiHandler->hasExited())
+        return;
+    // The script may have exited without reading all of its input
+    closeCgiInput(cgiHandler);
+    int cgiStatus = cgiHandler->isCgiDone();
+    if (connection.getResponse()) {
+        // Headers already forwarded: the exit status can no longer change the response
+        if (cgiStatus)
+            Logger::instance().log(WARNING, "CGI exited with status " + to_string(cgiStatus) + " after sending its headers");
+        std::vector<int> waiters;
+        const CachedResponse* shared = cgiStatus ? NULL : cgiHandler->finishRecord(waiters);
+        if (shared)
+            shareCgiResponse(*shared, waiters);
+        connection.getResponse()->endStream();
+        delete cgiHandler;
+        connection.setCgiHandler(NULL);
+        _poller->enable(client_fd, POLLOUT);
+        _pending.insert(client_fd);
+        return;
+    }
+    if (cgiStatus && !cgiHandler->hasReceivedBody()) {
+        HTTPResponse* cgiResponse = new HTTPResponse();
+        if (cgiHandler->isFastCGI())
+            cgiResponse->beError(502, "FastCGI application failed, status : " + to_string(cgiStatus));
+        else
+            cgiResponse->beError(500, std::string("CGI process was stopped unintentionnally Exit code : ") + to_string(cgiStatus));
+        abortCgi(connection, client_fd, cgiResponse);
+        return;
+    }
+    setCgiResponse(connection, client_fd);
+}
+
+void EventLoop::abortCgi(ClientConnection& connection, int client_fd, HTTPResponse* errorResponse) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    _cgiPids.erase(cgiHandler->getPid());
+    unwatch(cgiHandler->getInputPipeFd());
+    unwatch(cgiHandler->getOutputPipeFd());
+    cgiHandler->terminateCGI();
+    delete cgiHandler;
+    connection.setCgiHandler(NULL);
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(errorResponse);
+    connection.prepareResponse();
+    _poller->enable(client_fd, POLLOUT);
+    _pending.insert(client_fd);
+}
+
+void EventLoop::handleEvent(int fd, short revents) {
+    // Copied: registering a new fd may reallocate the registry
+    FDEntry entry = _registry.get(fd);
+    FDType fdType = entry.type;
+
+    if (fdType == FD_SIGNAL_PIPE) {
+        handleSignal(revents);
+        return;
+    }
+    if (fdType == FD_FASTCGI) {
+        handleFastCgi(entry, fd, revents);
+        return;
+    }
+    if (fdType == FD_SPAWN_STATUS) {
+        handleSpawnStatus(fd, revents);
+        return;
+    }
+
+    // Gérer les erreurs
+    if (revents & POLLERR) {
+        Logger::instance().log(ERROR, "Error on file descriptor: " + to_string(fd));
+        if (fdType == FD_SERVER_SOCKET) {
+            Logger::instance().log(ERROR, "Error on server socket detected by poller");
+        } else if (fdType == FD_CLIENT_SOCKET) {
+            Logger::instance().log(ERROR, "Error on client socket detected by poller");
+            closeConnection(fd);
+        } else {
+            unwatch(fd);
+        }
+        return;
+    }
+
+    // Gérer les déconnexions
+    if (revents & POLLHUP) {
+        if (fdType == FD_CLIENT_SOCKET) {
+            Logger::instance().log(INFO, "Disconnected client FD: " + to_string(fd));
+            closeConnection(fd);
+        } else if (fdType == FD_CGI_OUTPUT) {
+            handleCgiOutput(entry, fd, true);
+        } else if (fdType == FD_CGI_INPUT) {
+            // The script closed its stdin before reading everything
+            handleCgiInput(entry, fd, true);
+        } else {
+            unwatch(fd);
+        }
+        return;
+    }
+
+    if (revents & POLLNVAL) {
+        Logger::instance().log(ERROR, "File descriptor not valid: " + to_string(fd));
+        unwatch(fd);
+        return;
+    }
+
+    // Gérer POLLIN et POLLOUT
+    if (revents & POLLIN) {
+        if (fdType == FD_SERVER_SOCKET) {
+            acceptClient(fd, entry.server);
+            return;
+        } else if (fdType == FD_CLIENT_SOCKET) {
+            ClientConnection& connection = *entry.connection;
+            connection.getServer()->handleClient(fd, connection);
+            _pending.insert(fd);
+            return;
+        } else if (fdType == FD_CGI_OUTPUT) {
+            handleCgiOutput(entry, fd, false);
+            return;
+        } else {
+            Logger::instance().log(WARNING, std::string("Unhandled POLLIN event on fd : ") + to_string(fd));
+        }
+    }
+    if (revents & POLLOUT) {
+        // C'est un socket prêt à écrire
+        if (fdType == FD_CLIENT_SOCKET) {
+            ClientConnection& connection = *entry.connection;
+            connection.getServer()->handleResponseSending(fd, connection);
+            _pending.insert(fd);
+        } else if (fdType == FD_CGI_INPUT) {
+            handleCgiInput(entry, fd, false);
+        } else {
+            Logger::instance().log(WARNING, std::string("Unhandled POLLOUT event on fd : ") + to_string(fd));
+        }
+    }
+}
+
+void EventLoop::acceptClient(int server_fd, Server* server) {
+    Logger::instance().log(DEBUG, std::string("POLLIN on server socket, new connection will be created for fd : ") + to_string(server_fd));
+    int client_fd = server->acceptNewClient(server_fd);
+
+    if (client_fd != -1) {
+        std::map<int, ClientConnection>::iterator it =
+            _connections.insert(std::make_pair(client_fd, ClientConnection(server))).first;
+        _registry.registerClient(client_fd, &it->second);
+        _poller->add(client_fd, POLLIN);
+        _pending.insert(client_fd);
+        Logger::instance().log(DEBUG, "New client FD: " + to_string(client_fd) + " accepted on server FD: " + to_string(server_fd));
+    } else {
+        Logger::instance().log(ERROR, "Failure accepting client on server FD: " + to_string(server_fd));
+    }
+}
+
+// A script may answer before reading its whole body: what is left of it
+// cannot be told apart from the next request
+void EventLoop::keepAliveUnlessBodyPending(ClientConnection& connection, HTTPResponse& response) {
+    HTTPRequest* request = connection.getRequest();
+    response.setHeader("Connection", request && !request->isComplete() ? "close" : "keep-alive");
+}
+
+void EventLoop::setCgiResponse(ClientConnection& connection, int client_fd) {
+    std::string cgiOutput = connection.getCgiHandler()->getCGIOutput();
+    HTTPResponse* cgiResponse = new HTTPResponse();
+    cgiResponse->parseCGIOutput(cgiOutput);
+    keepAliveUnlessBodyPending(connection, *cgiResponse);
+
+    if (connection.getResponse())
+        delete connection.getResponse();
+    connection.setResponse(cgiResponse);
+    connection.getServer()->encodeResponse(connection);
+    connection.prepareResponse();
+
+    delete connection.getCgiHandler();
+    connection.setCgiHandler(NULL);
+
+    // Activer POLLOUT sur le descripteur du client pour envoyer la réponse
+    _poller->enable(client_fd, POLLOUT);
+    _pending.insert(client_fd);
+}
+
+// Identical requests that waited for the script get a copy of its response
+void EventLoop::shareCgiResponse(const CachedResponse& shared, const std::vector<int>& waiters) {
+    unsigned long now = curr_time_ms();
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        std::map<int, ClientConnection>::iterator it = _connections.find(waiters[i]);
+        if (it == _connections.end())
+            continue;
+        ClientConnection& connection = it->second;
+        connection.setCgiCache(NULL);
+        HTTPResponse* response = new HTTPResponse();
+        CGICache::fill(shared, *response, now);
+        response->setHeader("Content-Length", to_string(shared.body.size()));
+        keepAliveUnlessBodyPending(connection, *response);
+        connection.setResponse(response);
+        connection.getServer()->encodeResponse(connection);
+        connection.prepareResponse();
+        _poller->modify(it->first, POLLOUT);
+        _pending.insert(it->first);
+    }
+}
+
+// Starts the response once the CGI headers are complete, then hands it the
+// body as it is read
+void EventLoop::streamCgiOutput(ClientConnection& connection, int client_fd) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    HTTPResponse* response = connection.getResponse();
+    if (!response) {
+        std::string headers;
+        if (!cgiHandler->takeHeaders(headers))
+            return;
+        response = new HTTPResponse();
+        response->parseHeaders(headers);
+        // The transfer coding is ours to choose, not the script's
+        response->removeHeader("Transfer-Encoding");
+        cgiHandler->recordHeaders(*response, curr_time_ms());
+        response->setStreamBody();
+        keepAliveUnlessBodyPending(connection, *response);
+        if (response->findHeader("Content-Length").empty())
+            response->setHeader("Transfer-Encoding", "chunked");
+        connection.setResponse(response);
+        connection.getServer()->encodeResponse(connection);
+        connection.prepareResponse();
+#if defined(__linux__)
+        // Identity body of known length: the rest of the output skips user space
+        if (!response->getBodyEncoder() && response->getStrHeader("Transfer-Encoding").empty()
+            && !cgiHandler->isFastCGI() && !cgiHandler->isRecording()) {
+            cgiHandler->setSplicing(true);
+            cgiHandler->setOutputReady(true);
+            cgiHandler->setOutputPaused(true);
+            _poller->disable(cgiHandler->getOutputPipeFd(), POLLIN);
+        }
+#endif
+    }
+    std::string output;
+    cgiHandler->takeOutput(output);
+    cgiHandler->recordOutput(output);
+    if (!output.empty())
+        response->appendStream(output);
+    _pending.insert(client_fd);
+}
+
+// While the script runs, the request body flows from the client socket to its
+// stdin and its output back to the socket; each side waits when the other
+// falls behind. Returns false once the connection has been closed.
+bool EventLoop::updateCgiFlow(int client_fd, ClientConnection& connection) {
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    HTTPRequest* request = connection.getRequest();
+    bool bodyPending = request && !request->isComplete();
+
+    if (request && request->getErrorCode() != 0) {
+        // The body cannot be delivered to the script anymore
+        if (connection.getResponse()) {
+            closeConnection(client_fd);
+            return false;
+        }
+        HTTPResponse* errorResponse = new HTTPResponse();
+        errorResponse->beError(request->getErrorCode());
+        errorResponse->setHeader("Connection", "close");
+        abortCgi(connection, client_fd, errorResponse);
+        return true;
+    }
+
+    int inputFd = cgiHandler->getInputPipeFd();
+    short events = 0;
+    if (connection.getResponse() && !connection.isStreamStarved())
+        events |= POLLOUT;
+    // Read the body only as fast as the script consumes it
+    if (bodyPending && inputFd != -1 && cgiHandler->getInputBacklog() < CGIHandler::INPUT_HIGH_WATER)
+        events |= POLLIN;
+    _poller->modify(client_fd, events);
+
+    // Body received, or its end, since the script ran out of input
+    if (inputFd != -1 && cgiHandler->isInputPaused() && (cgiHandler->getInputBacklog() > 0 || !bodyPending)) {
+        cgiHandler->setInputPaused(false);
+        _poller->enable(inputFd, POLLOUT);
+    }
+    // Script output read again once the client caught up, or once a spliced
+    // pipe was found empty
+    bool wantOutput = cgiHandler->isSplicing() ? !cgiHandler->isOutputReady()
+        : connection.getStreamBacklog() <= CGIHandler::OUTPUT_LOW_WATER;
+    if (cgiHandler->isOutputPaused() && wantOutput) {
+        cgiHandler->setOutputPaused(false);
+        if (cgiHandler->getOutputPipeFd() != -1)
+            _poller->enable(cgiHandler->getOutputPipeFd(), POLLIN);
+    }
+    return true;
+}
+
+void EventLoop::handleCgiOutput(const FDEntry& entry, int fd, bool hangup) {
+    ClientConnection& connection = *entry.connection;
+    CGIHandler* cgiHandler = connection.getCgiHandler();
+    if (!cgiHandler) {
+        unwatch(fd);
+        return;
+    }
+    if (hangup) {
+        // No writer left: drain what is still buffered in the pipe
+        while (cgiHandler->readFromCGI() > 0)
+            ;
+        streamCgiOutput(connection, entry.clientFd);
+        // Fermer le descripteur de sortie du pipe
+        closeCgiOutput(cgiHandler);
+        finishCgi(connection, entry.clientFd);
+        return;
+    }
+    if (cgiHandler->isSplicing()) {
+        // Readable with nothing to read: end of output
+        int available = 0;
+        if (ioctl(fd, FIONREAD, &available) == 0 && available == 0) {
+            closeCgiOutput(cgiHandler);
+            finishCgi(connection, entry.clientFd);
+            return;
+        }
+        // Left in the pipe until the socket takes it
+        cgiHandler->setOutputReady(true);
+        cgiHandler->setOutputPaused(true);
+        _poller->disable(fd, POLLIN);
+        _pending.insert(entry.clientFd);
+        return;
+    }
+    int received = cgiHandler->readFromCGI();
+    if (!received) {
+        // A FastCGI reply may end in the same read as its last data
+        streamCgiOutput(connection, entry.clientFd);
+        closeCgiOutput(cgiHandler);
+        finishCgi(connection, entry.clientFd);
+        return;
+    }
+    streamCgiOutput(connection, entry.clientFd);
+    // Backpressure: a slow client stops the script once the pipe is full
+    if (connection.getStreamBacklog() >= CGIHandler::OUTPUT_HIGH_WATER) {
+        cgiHandler->setOutputPaused(true);
+        _poller->disable(fd, POLLIN);
+    }
+}
+
+void EventLoop::handleCgiInput(const FDEntry& entry, int fd, bool hangup) {
+    CGIHandler* cgiHandler = entry.connection->getCgiHandler();
+    if (!cgiHandler) {
+        unwatch(fd);
+        return;
+    }
+    // Writing to a pipe without reader would only raise SIGPIPE
+    int sending = hangup ? 0 : cgiHandler->writeToCGI();
+    if (!sending || sending == -1) {
+        closeCgiInput(cgiHandler);
+    } else if (sending == 2) {
+        // Resumed by updateCgiFlow() once the client sent more
+        cgiHandler->setInputPaused(true);
+        _poller->disable(fd, POLLOUT);
+    }
+    // The client socket may be read again
+    _pending.insert(entry.clientFd);
+}
+
+// The request is written and the reply read on the same socket
+void EventLoop::handleFastCgi(const FDEntry& entry, int fd, short revents) {
+    CGIHandler* cgiHandler = entry.connection->getCgiHandler();
+    if (!cgiHandler) {
+        unwatch(fd);
+        return;
+    }
+    if ((revents & POLLOUT) && cgiHandler->getInputPipeFd() != -1)
+        handleCgiInput(entry, fd, false);
+    // Errors, a refused connection included, surface as the end of the reply
+    bool hangup = revents & (POLLHUP | POLLERR);
+    if ((revents & POLLIN) || hangup)
+        handleCgiOutput(entry, fd, hangup);
+}
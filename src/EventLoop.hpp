@@ -0,0 +1,90 @@
+// EventLoop.hpp
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include "Poller.hpp"
+#include "ClientConnection.hpp"
+#include "FDRegistry.hpp"
+#include "TimerWheel.hpp"
+#include "Utils.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <sys/types.h>
+
+class Server;
+class HTTPResponse;
+class CGIHandler;
+class CGISpawner;
+struct CachedResponse;
+
+class EventLoop {
+public:
+    // Takes ownership of the poller
+    EventLoop(Poller* poller);
+    ~EventLoop();
+
+    void addListener(int fd, Server* server);
+    void addSignalPipe(int fd);
+    // Exit statuses of the scripts forked by the spawn helpers
+    void addSpawner(CGISpawner* spawner);
+    void run();
+    // Closes every client connection, stopping their scripts
+    void closeConnections();
+
+private:
+    Poller* _poller;
+    // Declared before the connections: their timers unlink themselves on destruction
+    TimerWheel _timers;
+    std::map<int, ClientConnection> _connections;
+    // Client fds touched since the last manageConnections() pass
+    std::set<int> _pending;
+    FDRegistry _registry;
+    // Running CGI children -> client fd, to route SIGCHLD
+    std::map<pid_t, int> _cgiPids;
+    CGISpawner* _spawner;
+    // Owners of the CGI queues, polled for freed slots
+    std::set<Server*> _servers;
+    std::vector<PollerEvent> _ready;
+    // Fds dropped while dispatching the current batch: their remaining events
+    // are stale, even if the number was already reused by a new fd
+    std::set<int> _dropped;
+    bool _stopServer;
+
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+
+    void manageConnections();
+    bool updateConnection(int client_fd, ClientConnection& connection);
+    void refreshTimer(int client_fd, ClientConnection& connection);
+    void armTimer(int client_fd, ClientConnection& connection, TimerKind kind, unsigned long deadline);
+    void expireTimers();
+    void handleTimeout(int client_fd, ClientConnection& connection, TimerKind kind);
+    void closeConnection(int client_fd);
+
+    void watchCgiPipe(int fd, FDType type, short events, int client_fd, ClientConnection& connection);
+    void unwatch(int fd);
+    void closeCgiInput(CGIHandler* cgiHandler);
+    void closeCgiOutput(CGIHandler* cgiHandler);
+
+    void handleEvent(int fd, short revents);
+    void handleSignal(short revents);
+    void reapChildren();
+    void handleSpawnStatus(int fd, short revents);
+    void childExited(pid_t pid, int status);
+    void finishCgi(ClientConnection& connection, int client_fd);
+    void abortCgi(ClientConnection& connection, int client_fd, HTTPResponse* errorResponse);
+    void acceptClient(int server_fd, Server* server);
+    void handleCgiOutput(const FDEntry& entry, int fd, bool hangup);
+    void handleCgiInput(const FDEntry& entry, int fd, bool hangup);
+    void handleFastCgi(const FDEntry& entry, int fd, short revents);
+    void setCgiResponse(ClientConnection& connection, int client_fd);
+    void streamCgiOutput(ClientConnection& connection, int client_fd);
+    void shareCgiResponse(const CachedResponse& shared, const std::vector<int>& waiters);
+    bool updateCgiFlow(int client_fd, ClientConnection& connection);
+    void keepAliveUnlessBodyPending(ClientConnection& connection, HTTPResponse& response);
+};
+
+#endif
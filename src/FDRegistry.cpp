@@ -0,0 +1,65 @@
+// FDRegistry.cpp
+#include "FDRegistry.hpp"
+
+FDRegistry::FDRegistry() {}
+
+FDRegistry::~FDRegistry() {}
+
+void FDRegistry::set(int fd, const FDEntry& entry) {
+    if (fd < 0)
+        return;
+    if (static_cast<size_t>(fd) >= _entries.size())
+        _entries.resize(fd + 1);
+    _entries[fd] = entry;
+}
+
+void FDRegistry::registerListener(int fd, Server* server) {
+    FDEntry entry;
+    entry.type = FD_SERVER_SOCKET;
+    entry.server = server;
+    set(fd, entry);
+}
+
+void FDRegistry::registerSignalPipe(int fd) {
+    FDEntry entry;
+    entry.type = FD_SIGNAL_PIPE;
+    set(fd, entry);
+}
+
+void FDRegistry::registerSpawnStatus(int fd) {
+    FDEntry entry;
+    entry.type = FD_SPAWN_STATUS;
+    set(fd, entry);
+}
+
+void FDRegistry::registerClient(int fd, ClientConnection* connection) {
+    FDEntry entry;
+    entry.type = FD_CLIENT_SOCKET;
+    entry.connection = connection;
+    entry.clientFd = fd;
+    set(fd, entry);
+}
+
+void FDRegistry::registerCgiPipe(int fd, FDType type, int clientFd, ClientConnection* connection) {
+    FDEntry entry;
+    entry.type = type;
+    entry.connection = connection;
+    entry.clientFd = clientFd;
+    set(fd, entry);
+}
+
+void FDRegistry::unregister(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= _entries.size())
+        return;
+    _entries[fd] = FDEntry();
+}
+
+const FDEntry& FDRegistry::get(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= _entries.size())
+        return _unknown;
+    return _entries[fd];
+}
+
+FDType FDRegistry::getType(int fd) const {
+    return get(fd).type;
+}
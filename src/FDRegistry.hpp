@@ -0,0 +1,45 @@
+// FDRegistry.hpp
+#ifndef FDREGISTRY_HPP
+#define FDREGISTRY_HPP
+
+#include "Utils.hpp"
+
+#include <vector>
+
+class Server;
+class ClientConnection;
+
+// Role and owner of every descriptor watched by the event loop
+struct FDEntry {
+    FDType type;
+    Server* server;
+    ClientConnection* connection;
+    int clientFd;
+
+    FDEntry() : type(FD_UNKNOWN), server(NULL), connection(NULL), clientFd(-1) {}
+};
+
+// Direct fd -> entry table, so an event is dispatched without searching
+class FDRegistry {
+public:
+    FDRegistry();
+    ~FDRegistry();
+
+    void registerListener(int fd, Server* server);
+    void registerSignalPipe(int fd);
+    void registerSpawnStatus(int fd);
+    void registerClient(int fd, ClientConnection* connection);
+    void registerCgiPipe(int fd, FDType type, int clientFd, ClientConnection* connection);
+    void unregister(int fd);
+
+    const FDEntry& get(int fd) const;
+    FDType getType(int fd) const;
+
+private:
+    std::vector<FDEntry> _entries;
+    FDEntry _unknown;
+
+    void set(int fd, const FDEntry& entry);
+};
+
+#endif
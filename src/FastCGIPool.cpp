@@ -0,0 +1,92 @@
+// FastCGIPool.cpp
+#include "FastCGIPool.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+FastCGIPool::FastCGIPool(const std::string& address, size_t maxIdle) : _address(address), _maxIdle(maxIdle) {}
+
+FastCGIPool::~FastCGIPool() {
+    for (size_t i = 0; i < _idle.size(); ++i)
+        close(_idle[i]);
+}
+
+bool FastCGIPool::keepsConnections() const { return _maxIdle > 0; }
+const std::string& FastCGIPool::getAddress() const { return _address; }
+
+bool FastCGIPool::isValidAddress(const std::string& address) {
+    if (address.compare(0, 5, "unix:") == 0)
+        return address.size() > 5 && address.size() - 5 < sizeof(((struct sockaddr_un*)0)->sun_path);
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size()
+        || address.find_first_not_of("0123456789", colon + 1) != std::string::npos)
+        return false;
+    long port = std::strtol(address.c_str() + colon + 1, NULL, 10);
+    return port > 0 && port < 65536 && inet_addr(address.substr(0, colon).c_str()) != INADDR_NONE;
+}
+
+int FastCGIPool::acquire() {
+    while (!_idle.empty()) {
+        int fd = _idle.back();
+        _idle.pop_back();
+        // An idle connection has nothing to read unless the application closed it
+        char byte;
+        ssize_t peeked = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (peeked == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return fd;
+        close(fd);
+    }
+    return connectTo();
+}
+
+void FastCGIPool::release(int fd) {
+    if (_idle.size() < _maxIdle)
+        _idle.push_back(fd);
+    else
+        close(fd);
+}
+
+int FastCGIPool::connectTo() const {
+    struct sockaddr_storage storage;
+    socklen_t length;
+    std::memset(&storage, 0, sizeof(storage));
+
+    if (_address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un* address = reinterpret_cast<struct sockaddr_un*>(&storage);
+        address->sun_family = AF_UNIX;
+        std::strncpy(address->sun_path, _address.c_str() + 5, sizeof(address->sun_path) - 1);
+        length = sizeof(*address);
+    } else {
+        size_t colon = _address.rfind(':');
+        struct sockaddr_in* address = reinterpret_cast<struct sockaddr_in*>(&storage);
+        address->sin_family = AF_INET;
+        address->sin_port = htons(static_cast<unsigned short>(std::atoi(_address.c_str() + colon + 1)));
+        address->sin_addr.s_addr = inet_addr(_address.substr(0, colon).c_str());
+        length = sizeof(*address);
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        Logger::instance().log(ERROR, std::string("FastCGI socket failed: ") + strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    set_close_on_exec(fd);
+    // Completion, or failure, of a connection in progress is reported by the poller
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&storage), length) == -1 && errno != EINPROGRESS) {
+        Logger::instance().log(ERROR, "FastCGI connect to " + _address + " failed: " + strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,38 @@
+// FastCGIPool.hpp
+#ifndef FASTCGIPOOL_HPP
+#define FASTCGIPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Connections to one FastCGI application, "unix:/path/to.sock" or
+// "host:port". Connections whose request ended cleanly are kept open for
+// the next one, up to maxIdle.
+class FastCGIPool {
+public:
+    FastCGIPool(const std::string& address, size_t maxIdle);
+    ~FastCGIPool();
+
+    // Idle connection, or a new non-blocking one possibly still connecting.
+    // -1 when the address is invalid or the connection was refused.
+    int acquire();
+    // Back to the pool: the application was asked to keep it open
+    void release(int fd);
+    bool keepsConnections() const;
+    const std::string& getAddress() const;
+
+    static bool isValidAddress(const std::string& address);
+
+private:
+    std::string _address;
+    size_t _maxIdle;
+    std::vector<int> _idle;
+
+    int connectTo() const;
+
+    FastCGIPool(const FastCGIPool&);
+    FastCGIPool& operator=(const FastCGIPool&);
+};
+
+#endif
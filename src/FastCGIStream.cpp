@@ -0,0 +1,118 @@
+// FastCGIStream.cpp
+#include "FastCGIStream.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+
+// Record types and constants of the specification
+static const unsigned char FCGI_VERSION_1 = 1;
+static const unsigned char FCGI_BEGIN_REQUEST = 1;
+static const unsigned char FCGI_END_REQUEST = 3;
+static const unsigned char FCGI_PARAMS = 4;
+static const unsigned char FCGI_STDIN = 5;
+static const unsigned char FCGI_STDOUT = 6;
+static const unsigned char FCGI_STDERR = 7;
+static const unsigned char FCGI_RESPONDER = 1;
+static const unsigned char FCGI_KEEP_CONN = 1;
+static const size_t FCGI_HEADER_LEN = 8;
+
+// Bound to references by std::min
+const unsigned short FastCGIStream::REQUEST_ID;
+const size_t FastCGIStream::MAX_CONTENT;
+
+FastCGIStream::FastCGIStream() : _ended(false), _appStatus(0) {}
+
+void FastCGIStream::appendRecord(std::string& out, unsigned char type, const char* data, size_t len) {
+    // Content padded to a multiple of 8 bytes, as the specification recommends
+    unsigned char padding = static_cast<unsigned char>((8 - len % 8) % 8);
+    char header[FCGI_HEADER_LEN] = {
+        static_cast<char>(FCGI_VERSION_1), static_cast<char>(type),
+        static_cast<char>(REQUEST_ID >> 8), static_cast<char>(REQUEST_ID & 0xff),
+        static_cast<char>((len >> 8) & 0xff), static_cast<char>(len & 0xff),
+        static_cast<char>(padding), 0
+    };
+    out.append(header, sizeof(header));
+    out.append(data, len);
+    out.append(padding, '\0');
+}
+
+void FastCGIStream::appendBeginRequest(std::string& out, bool keepConnection) {
+    char body[8] = { 0, static_cast<char>(FCGI_RESPONDER), static_cast<char>(keepConnection ? FCGI_KEEP_CONN : 0), 0, 0, 0, 0, 0 };
+    appendRecord(out, FCGI_BEGIN_REQUEST, body, sizeof(body));
+}
+
+// Lengths below 128 take one byte, others four with the high bit set
+static void appendLength(std::string& out, size_t len) {
+    if (len < 128) {
+        out += static_cast<char>(len);
+    } else {
+        out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+        out += static_cast<char>((len >> 16) & 0xff);
+        out += static_cast<char>((len >> 8) & 0xff);
+        out += static_cast<char>(len & 0xff);
+    }
+}
+
+void FastCGIStream::appendParams(std::string& out, const std::vector<std::pair<std::string, std::string> >& params) {
+    std::string content;
+    for (size_t i = 0; i < params.size(); ++i) {
+        appendLength(content, params[i].first.size());
+        appendLength(content, params[i].second.size());
+        content += params[i].first;
+        content += params[i].second;
+    }
+    for (size_t offset = 0; offset < content.size(); offset += MAX_CONTENT)
+        appendRecord(out, FCGI_PARAMS, content.data() + offset, std::min(MAX_CONTENT, content.size() - offset));
+    appendRecord(out, FCGI_PARAMS, "", 0);
+}
+
+void FastCGIStream::appendStdin(std::string& out, const char* data, size_t len) {
+    if (len == 0) {
+        appendRecord(out, FCGI_STDIN, "", 0);
+        return;
+    }
+    for (size_t offset = 0; offset < len; offset += MAX_CONTENT)
+        appendRecord(out, FCGI_STDIN, data + offset, std::min(MAX_CONTENT, len - offset));
+}
+
+bool FastCGIStream::decode(const char* data, size_t len, std::string& out) {
+    _pending.append(data, len);
+    size_t pos = 0;
+    while (!_ended && _pending.size() - pos >= FCGI_HEADER_LEN) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(_pending.data() + pos);
+        size_t contentLength = (header[4] << 8) | header[5];
+        size_t recordLength = FCGI_HEADER_LEN + contentLength + header[6];
+        if (header[0] != FCGI_VERSION_1)
+            return false;
+        if (_pending.size() - pos < recordLength)
+            break;
+        const char* content = _pending.data() + pos + FCGI_HEADER_LEN;
+        unsigned short requestId = (header[2] << 8) | header[3];
+
+        if (requestId != REQUEST_ID) {
+            // Management records (request id 0) are not used by this client
+            Logger::instance().log(DEBUG, "FastCGI: ignored record of type " + to_string(static_cast<int>(header[1])));
+        } else if (header[1] == FCGI_STDOUT) {
+            out.append(content, contentLength);
+        } else if (header[1] == FCGI_STDERR) {
+            if (contentLength > 0)
+                Logger::instance().log(WARNING, "FastCGI stderr: " + std::string(content, contentLength));
+        } else if (header[1] == FCGI_END_REQUEST) {
+            if (contentLength < 8)
+                return false;
+            const unsigned char* body = reinterpret_cast<const unsigned char*>(content);
+            _appStatus = static_cast<int>((static_cast<unsigned long>(body[0]) << 24) | (body[1] << 16) | (body[2] << 8) | body[3]);
+            // protocolStatus other than FCGI_REQUEST_COMPLETE: the request was refused
+            if (body[4] != 0 && _appStatus == 0)
+                _appStatus = -1;
+            _ended = true;
+        }
+        pos += recordLength;
+    }
+    _pending.erase(0, pos);
+    return true;
+}
+
+bool FastCGIStream::isEnded() const { return _ended; }
+int FastCGIStream::getAppStatus() const { return _appStatus; }
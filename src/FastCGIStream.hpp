@@ -0,0 +1,43 @@
+// FastCGIStream.hpp
+#ifndef FASTCGISTREAM_HPP
+#define FASTCGISTREAM_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// Record layer of the FastCGI protocol (specification 1.0) for a responder
+// running one request at a time on its connection
+class FastCGIStream {
+public:
+    static const unsigned short REQUEST_ID = 1;
+    // Largest content of a single record
+    static const size_t MAX_CONTENT = 65535;
+
+    FastCGIStream();
+
+    // keepConnection: the application leaves the connection open after the reply
+    static void appendBeginRequest(std::string& out, bool keepConnection);
+    // Name-value pairs followed by the empty record ending them
+    static void appendParams(std::string& out, const std::vector<std::pair<std::string, std::string> >& params);
+    // An empty data ends the request body
+    static void appendStdin(std::string& out, const char* data, size_t len);
+
+    // Decodes the records received so far: stdout is appended to out, stderr
+    // is logged. Returns false on a malformed stream.
+    bool decode(const char* data, size_t len, std::string& out);
+    // FCGI_END_REQUEST received
+    bool isEnded() const;
+    int getAppStatus() const;
+
+private:
+    // Incomplete record kept for the next read
+    std::string _pending;
+    bool _ended;
+    int _appStatus;
+
+    static void appendRecord(std::string& out, unsigned char type, const char* data, size_t len);
+};
+
+#endif
@@ -0,0 +1,97 @@
+// FileCache.cpp
+#include "FileCache.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+
+#include <unistd.h>
+
+FileCache::FileCache(size_t capacity, size_t maxFileSize, unsigned long validMs)
+    : _capacity(capacity), _maxFileSize(maxFileSize), _validMs(validMs), _used(0) {}
+
+FileCache::~FileCache() {}
+
+bool FileCache::accepts(off_t size) const {
+    return _capacity > 0 && size >= 0 && static_cast<size_t>(size) <= _maxFileSize
+        && static_cast<size_t>(size) <= _capacity;
+}
+
+size_t FileCache::cost(const CachedFile& entry) {
+    return entry.body.size() + entry.path.size();
+}
+
+void FileCache::erase(EntryList::iterator it) {
+    _used -= cost(*it);
+    _index.erase(it->path);
+    _entries.erase(it);
+}
+
+const CachedFile* FileCache::lookup(const std::string& path, unsigned long now) {
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(path);
+    if (found == _index.end())
+        return NULL;
+    EntryList::iterator it = found->second;
+
+    if (now - it->validatedAt >= _validMs) {
+        struct stat st;
+        if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)
+            || st.st_size != it->size || st.st_mtime != it->mtime || st.st_ino != it->inode) {
+            Logger::instance().log(DEBUG, "File cache: " + path + " changed on disk, dropped");
+            erase(it);
+            return NULL;
+        }
+        it->etag = makeETag(st);
+        it->validatedAt = now;
+    }
+    _entries.splice(_entries.begin(), _entries, it);
+    return &*it;
+}
+
+const CachedFile* FileCache::insert(const std::string& path, int fd, const struct stat& st, unsigned long now) {
+    if (!accepts(st.st_size))
+        return NULL;
+
+    std::string body(static_cast<size_t>(st.st_size), '\0');
+    size_t total = 0;
+    while (total < body.size()) {
+        ssize_t bytes = pread(fd, &body[total], body.size() - total, total);
+        if (bytes == -1 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return NULL;
+        total += bytes;
+    }
+
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(path);
+    if (found != _index.end())
+        erase(found->second);
+
+    _entries.push_front(CachedFile());
+    CachedFile& entry = _entries.front();
+    entry.path = path;
+    entry.body.swap(body);
+    entry.contentLength = to_string(st.st_size);
+    entry.etag = makeETag(st);
+    entry.lastModified = http_date(st.st_mtime);
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    entry.inode = st.st_ino;
+    entry.validatedAt = now;
+    _index[path] = _entries.begin();
+    _used += cost(entry);
+
+    while (_used > _capacity && _entries.size() > 1)
+        erase(--_entries.end());
+    return &_entries.front();
+}
+
+std::string FileCache::makeETag(const struct stat& st) {
+    char buffer[64];
+    bool weak = st.st_mtime >= time(NULL);
+    snprintf(buffer, sizeof(buffer), "%s\"%lx-%lx-%lx\"", weak ? "W/" : "", static_cast<unsigned long>(st.st_ino),
+             static_cast<unsigned long>(st.st_mtime), static_cast<unsigned long>(st.st_size));
+    return buffer;
+}
@@ -0,0 +1,61 @@
+// FileCache.hpp
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <list>
+#include <map>
+#include <string>
+#include <cstddef>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Small static file kept in memory with its precomputed headers
+struct CachedFile {
+    std::string path;
+    std::string body;
+    std::string contentLength;
+    std::string etag;
+    std::string lastModified;
+    off_t size;
+    time_t mtime;
+    ino_t inode;
+    // Last time the entry was checked against the disk
+    unsigned long validatedAt;
+};
+
+// LRU content cache keyed by resolved path, bounded by a byte budget.
+// Entries are trusted for validMs, then revalidated with a single stat().
+class FileCache {
+public:
+    FileCache(size_t capacity, size_t maxFileSize, unsigned long validMs);
+    ~FileCache();
+
+    bool accepts(off_t size) const;
+    // NULL on a miss or when the file changed on disk (the entry is dropped)
+    const CachedFile* lookup(const std::string& path, unsigned long now);
+    // Reads the whole file from fd; NULL if it could not be read
+    const CachedFile* insert(const std::string& path, int fd, const struct stat& st, unsigned long now);
+
+    // Strong validator, weak while the file may still change within its mtime second
+    static std::string makeETag(const struct stat& st);
+
+private:
+    typedef std::list<CachedFile> EntryList;
+
+    size_t _capacity;
+    size_t _maxFileSize;
+    unsigned long _validMs;
+    size_t _used;
+    // Most recently used first
+    EntryList _entries;
+    std::map<std::string, EntryList::iterator> _index;
+
+    FileCache(const FileCache&);
+    FileCache& operator=(const FileCache&);
+
+    void erase(EntryList::iterator it);
+    static size_t cost(const CachedFile& entry);
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef GLOBALCONFIG_HPP
+#define GLOBALCONFIG_HPP
+
+#include <string>
+
+// Directives written outside of any server block
+struct GlobalConfig {
+	std::string eventBackend;
+	// 0 means one worker per online CPU ("auto")
+	int workerProcesses;
+	// Helper processes forking the CGI scripts, per worker (0: the worker forks)
+	int cgiSpawnHelpers;
+
+	GlobalConfig() : eventBackend(""), workerProcesses(1), cgiSpawnHelpers(0) {}
+};
+
+#endif
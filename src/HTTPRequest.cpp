@@ -8,144 +8,509 @@
 #include <iostream>
 
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <limits>
 
 HTTPRequest::HTTPRequest()
-    : _complete(false), _connectionClosed(false), _maxBodySize(0),
+    : _state(PARSE_METHOD), _parsePos(0), _tokenStart(0), _valueEnd(0),
+      _chunked(false), _chunkSize(0), _chunkDigits(0), _trailerSize(0), _complete(false), _connectionClosed(false), _maxBodySize(0),
       _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _errorCode(0) {
         setLastActivity(curr_time_ms());
       }
 
 HTTPRequest::HTTPRequest(int max_body_size)
-    : _complete(false), _connectionClosed(false), _maxBodySize(max_body_size),
+    : _state(PARSE_METHOD), _parsePos(0), _tokenStart(0), _valueEnd(0),
+      _chunked(false), _chunkSize(0), _chunkDigits(0), _trailerSize(0), _complete(false), _connectionClosed(false), _maxBodySize(max_body_size),
       _contentLength(0), _bodyReceived(0), _headersParsed(false), _requestTooLarge(false), _errorCode(0) {
         setLastActivity(curr_time_ms());
       }
 
 HTTPRequest::~HTTPRequest() {}
 
-bool HTTPRequest::hasHeader(std::string header) const {
-    std::map<std::string, std::string>::const_iterator it = _headers.find(header);
-    if (it != _headers.end())
+static bool isTokenChar(char c) {
+    if (std::isalnum(static_cast<unsigned char>(c)))
         return true;
-    return false;
+    return std::strchr("!#$%&'*+-.^_`|~", c) != NULL && c != '\0';
+}
+
+static bool isFieldChar(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    return uc == '\t' || (uc >= 0x20 && uc != 0x7f);
+}
+
+static bool equalsIgnoreCase(const std::string& buffer, size_t start, size_t len, const std::string& name) {
+    if (len != name.size())
+        return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (std::tolower(static_cast<unsigned char>(buffer[start + i])) != std::tolower(static_cast<unsigned char>(name[i])))
+            return false;
+    }
+    return true;
+}
+
+// Field names are case-insensitive; the last occurrence wins
+const HTTPRequest::HeaderField* HTTPRequest::findField(const std::string& name) const {
+    const HeaderField* found = NULL;
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        if (equalsIgnoreCase(_rawRequest, _fields[i].nameStart, _fields[i].nameLen, name))
+            found = &_fields[i];
+    }
+    return found;
+}
+
+bool HTTPRequest::hasHeader(std::string header) const {
+    return findField(header) != NULL;
 }
 
 std::string HTTPRequest::getStrHeader(std::string header) const {
-    std::map<std::string, std::string>::const_iterator it = _headers.find(header);
-    if (it == _headers.end())
+    const HeaderField* field = findField(header);
+    if (!field)
         return "";
-    return it->second;
+    return _rawRequest.substr(field->valueStart, field->valueLen);
 }
 
-void HTTPRequest::parseRawRequest(const ServerConfig& config) {
-    // Check if headers are fully received
-    size_t header_end_pos = _rawRequest.find("\r\n\r\n");
+void HTTPRequest::fail(int code) {
+    Logger::instance().log(ERROR, "Invalid HTTP request, error " + to_string(code) + " at byte " + to_string(_parsePos));
+    _errorCode = code;
+}
 
-    if (header_end_pos == std::string::npos) {
-        return;
+size_t HTTPRequest::feed(const char* data, size_t len) {
+    if (_complete || _errorCode)
+        return 0;
+    size_t consumed = 0;
+
+    if (!_headersParsed) {
+        size_t previous = _rawRequest.size();
+        _rawRequest.append(data, len);
+        parseHead();
+        if (_errorCode)
+            return len;
+        if (!_headersParsed)
+            return len;
+        // Bytes past the blank line are not part of the head
+        consumed = _parsePos - previous;
+        _rawRequest.erase(_parsePos);
+        finishHeaders();
+        if (_errorCode || _complete)
+            return consumed;
     }
 
-    size_t line_end_pos = _rawRequest.find("\r\n");
-    std::string request_line = _rawRequest.substr(0, line_end_pos);
-    std::istringstream iss(request_line);
-    iss >> _method >> _path;
+    if (_chunked) {
+        consumed += decodeChunked(data + consumed, len - consumed);
+    } else {
+        size_t wanted = _contentLength - _bodyReceived;
+        size_t taken = std::min(wanted, len - consumed);
+        _body.append(data + consumed, taken);
+        _bodyReceived += taken;
+        consumed += taken;
+        if (_bodyReceived >= _contentLength)
+            _complete = true;
+    }
+    return consumed;
+}
 
-    const Location* location = config.findLocation(_path);
+bool HTTPRequest::bodyExceedsLimit(size_t extra) const {
+    return _maxBodySize > 0 && _bodyReceived + extra > static_cast<size_t>(_maxBodySize);
+}
 
-	if (location) {
-		if (location->clientMaxBodySize != -1)
-	    	_maxBodySize = location->clientMaxBodySize;
+// Beyond this, a Range header costs more than sending the whole file
+static const size_t MAX_RANGES = 16;
+
+static bool parseOffset(const std::string& str, off_t& value) {
+	if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	value = 0;
+	for (size_t i = 0; i < str.size(); ++i) {
+		off_t digit = str[i] - '0';
+		if (value > (std::numeric_limits<off_t>::max() - digit) / 10)
+			return false;
+		value = value * 10 + digit;
 	}
-    std::string headers = getRawRequest().substr(0, header_end_pos);
-    std::istringstream headers_stream(headers);
-    std::string header_line;
-    while (std::getline(headers_stream, header_line)) {
-        if (!header_line.empty() && header_line[header_line.size() - 1] == '\r') {
-        	header_line.erase(header_line.size() - 1);
-    	}
-        size_t colon_pos = header_line.find(":");
-        if (colon_pos != std::string::npos) {
-            std::string header_name = header_line.substr(0, colon_pos);
-            std::string header_value = header_line.substr(colon_pos + 1);
-            // Trim whitespace
-            header_name.erase(0, header_name.find_first_not_of(" \t"));
-            header_name.erase(header_name.find_last_not_of(" \t") + 1);
-            header_value.erase(0, header_value.find_first_not_of(" \t"));
-            header_value.erase(header_value.find_last_not_of(" \t") + 1);
-
-            if (header_name == "Content-Length") {
-                _contentLength = static_cast<size_t>(atoi(header_value.c_str()));
-            }
-        }
-    }
+	return true;
+}
 
-    _headersParsed = true;
+HTTPRequest::RangeStatus HTTPRequest::getRanges(off_t size, std::vector<ByteRange>& ranges) const {
+	ranges.clear();
+	if (!hasHeader("Range"))
+		return RANGE_NONE;
+	std::string value = getStrHeader("Range");
+	trim(value);
+	if (value.compare(0, 6, "bytes=") != 0)
+		return RANGE_NONE;
+
+	std::istringstream specs(value.substr(6));
+	std::string spec;
+	size_t count = 0;
+	while (std::getline(specs, spec, ',')) {
+		trim(spec);
+		if (spec.empty())
+			continue;
+		if (++count > MAX_RANGES)
+			return RANGE_NONE;
+		size_t dash = spec.find('-');
+		if (dash == std::string::npos)
+			return RANGE_NONE;
+		std::string firstStr = spec.substr(0, dash);
+		std::string lastStr = spec.substr(dash + 1);
+		trim(firstStr);
+		trim(lastStr);
+
+		ByteRange range;
+		if (firstStr.empty()) {
+			// Suffix range: the last N bytes
+			off_t suffix;
+			if (!parseOffset(lastStr, suffix))
+				return RANGE_NONE;
+			if (suffix == 0 || size == 0)
+				continue;
+			range.first = suffix < size ? size - suffix : 0;
+			range.last = size - 1;
+		} else {
+			if (!parseOffset(firstStr, range.first))
+				return RANGE_NONE;
+			if (lastStr.empty()) {
+				range.last = size - 1;
+			} else if (!parseOffset(lastStr, range.last) || range.last < range.first) {
+				return RANGE_NONE;
+			}
+			if (range.first >= size)
+				continue;
+			if (range.last >= size)
+				range.last = size - 1;
+		}
+		ranges.push_back(range);
+	}
+	if (count == 0)
+		return RANGE_NONE;
+	return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_SATISFIABLE;
+}
 
-    // Check for request too large
-    if (_maxBodySize > 0 && _contentLength > static_cast<size_t>(_maxBodySize)) {
-        Logger::instance().log(WARNING, "Content-Length exceeds the configured maximum.");
-        _requestTooLarge = true;
-    }
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
 }
 
-bool HTTPRequest::parse() {
-    size_t header_end_pos = _rawRequest.find("\r\n\r\n");
-    if (header_end_pos == std::string::npos) {
-        Logger::instance().log(ERROR, "Invalid HTTP request: missing header-body separator.");
+bool HTTPRequest::endChunkSize() {
+    if (_chunkDigits == 0) {
+        fail(400);
         return false;
     }
-
-    std::string headers_part = _rawRequest.substr(0, header_end_pos);
-    std::string body_part = _rawRequest.substr(header_end_pos + 4);
-
-    std::istringstream header_stream(headers_part);
-    std::string line;
-
-    if (std::getline(header_stream, line)) {
-        if (!parseRequestLine(line)) {
-            return false;
-        }
-    } else {
-        Logger::instance().log(ERROR, "Invalid HTTP request: missing request line.");
+    // The limit applies to the decoded size, checked before buffering the chunk
+    if (bodyExceedsLimit(_chunkSize)) {
+        Logger::instance().log(WARNING, "Chunked request body exceeds the configured maximum.");
+        _requestTooLarge = true;
         return false;
     }
+    _state = _chunkSize == 0 ? PARSE_TRAILER_START : PARSE_CHUNK_DATA;
+    return true;
+}
 
-    // Parse headers
-    while (std::getline(header_stream, line) && !line.empty()) {
-        parseHeaders(line);
+// Decodes as much of the chunked body as available, appending chunk data to _body
+size_t HTTPRequest::decodeChunked(const char* data, size_t len) {
+    size_t i = 0;
+
+    while (i < len && !_complete && !_errorCode && !_requestTooLarge) {
+        char c = data[i];
+        switch (_state) {
+        case PARSE_CHUNK_SIZE:
+            if (hexValue(c) >= 0) {
+                if (_chunkSize > (static_cast<size_t>(-1) >> 4)) {
+                    fail(400);
+                    return i;
+                }
+                _chunkSize = _chunkSize * 16 + hexValue(c);
+                ++_chunkDigits;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                _state = PARSE_CHUNK_EXT;
+            } else if (c == '\r') {
+                _state = PARSE_CHUNK_SIZE_LF;
+            } else if (c == '\n') {
+                if (!endChunkSize())
+                    return i;
+            } else {
+                fail(400);
+                return i;
+            }
+            ++i;
+            break;
+        case PARSE_CHUNK_EXT:
+            // Chunk extensions are ignored
+            if (c == '\r') {
+                _state = PARSE_CHUNK_SIZE_LF;
+            } else if (c == '\n') {
+                if (!endChunkSize())
+                    return i;
+            } else if (!isFieldChar(c)) {
+                fail(400);
+                return i;
+            }
+            ++i;
+            break;
+        case PARSE_CHUNK_SIZE_LF:
+            if (c != '\n') {
+                fail(400);
+                return i;
+            }
+            if (!endChunkSize())
+                return i;
+            ++i;
+            break;
+        case PARSE_CHUNK_DATA: {
+            size_t taken = std::min(_chunkSize, len - i);
+            _body.append(data + i, taken);
+            _bodyReceived += taken;
+            _chunkSize -= taken;
+            i += taken;
+            if (_chunkSize == 0)
+                _state = PARSE_CHUNK_DATA_CR;
+            break;
+        }
+        case PARSE_CHUNK_DATA_CR:
+        case PARSE_CHUNK_DATA_LF:
+            if (c == '\r' && _state == PARSE_CHUNK_DATA_CR) {
+                _state = PARSE_CHUNK_DATA_LF;
+            } else if (c == '\n') {
+                _chunkDigits = 0;
+                _state = PARSE_CHUNK_SIZE;
+            } else {
+                fail(400);
+                return i;
+            }
+            ++i;
+            break;
+        case PARSE_TRAILER_START:
+            // Trailer fields are read and dropped
+            if (c == '\r') {
+                _state = PARSE_TRAILER_END_LF;
+            } else if (c == '\n') {
+                _complete = true;
+            } else if (isFieldChar(c)) {
+                _state = PARSE_TRAILER_LINE;
+            } else {
+                fail(400);
+                return i;
+            }
+            ++i;
+            break;
+        case PARSE_TRAILER_LINE:
+            if (c == '\r') {
+                _state = PARSE_TRAILER_LF;
+            } else if (c == '\n') {
+                _state = PARSE_TRAILER_START;
+            } else if (!isFieldChar(c)) {
+                fail(400);
+                return i;
+            }
+            ++i;
+            break;
+        case PARSE_TRAILER_LF:
+        case PARSE_TRAILER_END_LF:
+            if (c != '\n') {
+                fail(400);
+                return i;
+            }
+            if (_state == PARSE_TRAILER_END_LF)
+                _complete = true;
+            else
+                _state = PARSE_TRAILER_START;
+            ++i;
+            break;
+        default:
+            return i;
+        }
+        if (_state >= PARSE_TRAILER_START && ++_trailerSize > MAX_HEADER_SIZE) {
+            fail(431);
+            return i;
+        }
     }
+    return i;
+}
 
-    // Handle the body if there's a Content-Length
-    std::map<std::string, std::string>::iterator it = _headers.find("Content-Length");
-    if (it != _headers.end()) {
-        int content_length = std::atoi(it->second.c_str());
-        if (body_part.size() < static_cast<size_t>(content_length)) {
-            Logger::instance().log(ERROR, "Failed to read the entire body");
-            return false;
+// Resumes at _parsePos: every byte of the head is examined exactly once
+void HTTPRequest::parseHead() {
+    const std::string& buffer = _rawRequest;
+    size_t end = buffer.size();
+
+    for (; _parsePos < end; ++_parsePos) {
+        char c = buffer[_parsePos];
+        switch (_state) {
+        case PARSE_METHOD:
+            // Empty lines before the request line are ignored
+            if ((c == '\r' || c == '\n') && _parsePos == _tokenStart) {
+                _tokenStart = _parsePos + 1;
+            } else if (c == ' ' && _parsePos > _tokenStart) {
+                _method.assign(buffer, _tokenStart, _parsePos - _tokenStart);
+                _tokenStart = _parsePos + 1;
+                _state = PARSE_TARGET;
+            } else if (!isTokenChar(c)) {
+                return fail(400);
+            }
+            break;
+        case PARSE_TARGET:
+            if (c == ' ' && _parsePos > _tokenStart) {
+                _path.assign(buffer, _tokenStart, _parsePos - _tokenStart);
+                parseQueryString();
+                _tokenStart = _parsePos + 1;
+                _state = PARSE_VERSION;
+            } else if (c == ' ' || !isFieldChar(c) || c == '\t') {
+                return fail(400);
+            }
+            break;
+        case PARSE_VERSION:
+            if (c == '\r') {
+                if (!finishRequestLine(_parsePos))
+                    return;
+                _state = PARSE_REQUEST_LINE_LF;
+            } else if (c == '\n') {
+                if (!finishRequestLine(_parsePos))
+                    return;
+                _state = PARSE_HEADER_START;
+            } else if (!isFieldChar(c) || c == ' ' || c == '\t') {
+                return fail(400);
+            }
+            break;
+        case PARSE_REQUEST_LINE_LF:
+        case PARSE_HEADER_LF:
+            if (c != '\n')
+                return fail(400);
+            _state = PARSE_HEADER_START;
+            break;
+        case PARSE_HEADER_START:
+            if (c == '\r') {
+                _state = PARSE_HEADERS_END_LF;
+            } else if (c == '\n') {
+                ++_parsePos;
+                _headersParsed = true;
+                _state = PARSE_BODY;
+                return;
+            } else if (isTokenChar(c)) {
+                _field.nameStart = _parsePos;
+                _state = PARSE_HEADER_NAME;
+            } else {
+                // Includes obsolete line folding
+                return fail(400);
+            }
+            break;
+        case PARSE_HEADER_NAME:
+            if (c == ':') {
+                _field.nameLen = _parsePos - _field.nameStart;
+                _state = PARSE_HEADER_VALUE_START;
+            } else if (!isTokenChar(c)) {
+                return fail(400);
+            }
+            break;
+        case PARSE_HEADER_VALUE_START:
+            if (c == ' ' || c == '\t')
+                break;
+            _field.valueStart = _parsePos;
+            _valueEnd = _parsePos;
+            _state = PARSE_HEADER_VALUE;
+            // fall through
+        case PARSE_HEADER_VALUE:
+            if (c == '\r' || c == '\n') {
+                _field.valueLen = _valueEnd - _field.valueStart;
+                _fields.push_back(_field);
+                _state = (c == '\r') ? PARSE_HEADER_LF : PARSE_HEADER_START;
+            } else if (!isFieldChar(c)) {
+                return fail(400);
+            } else if (c != ' ' && c != '\t') {
+                _valueEnd = _parsePos + 1;
+            }
+            break;
+        case PARSE_HEADERS_END_LF:
+            if (c != '\n')
+                return fail(400);
+            ++_parsePos;
+            _headersParsed = true;
+            _state = PARSE_BODY;
+            return;
+        default:
+            // Body states are handled by feed()
+            return;
         }
-        parseBody(body_part.substr(0, content_length));
+        if (_parsePos >= MAX_HEADER_SIZE)
+            return fail(431);
     }
+}
 
+bool HTTPRequest::finishRequestLine(size_t versionEnd) {
+    std::string version(_rawRequest, _tokenStart, versionEnd - _tokenStart);
+    if (version != "HTTP/1.1") {
+        Logger::instance().log(ERROR, "Unsupported HTTP version: " + version);
+        fail(400);
+        return false;
+    }
     return true;
 }
 
-bool HTTPRequest::parseRequestLine(const std::string& line) {
-    std::istringstream iss(line);
-    std::string version;
-    iss >> _method >> _path >> version;
-
-    if (_method.empty() || _path.empty() || version.empty()) {
-        Logger::instance().log(ERROR, "Invalid HTTP Request");
-        return false;
+void HTTPRequest::finishHeaders() {
+    const HeaderField* encoding = findField("Transfer-Encoding");
+    const HeaderField* length = findField("Content-Length");
+    if (encoding) {
+        // Both framings at once is a request smuggling vector
+        if (length) {
+            fail(400);
+            return;
+        }
+        std::string codings = _rawRequest.substr(encoding->valueStart, encoding->valueLen);
+        if (!equalsIgnoreCase(codings, 0, codings.size(), "chunked")) {
+            std::string last = codings.substr(codings.find_last_of(',') + 1);
+            trim(last);
+            Logger::instance().log(ERROR, "Unsupported Transfer-Encoding: " + codings);
+            // chunked must be the final coding, other codings are not implemented
+            fail(equalsIgnoreCase(last, 0, last.size(), "chunked") ? 501 : 400);
+            return;
+        }
+        _chunked = true;
+        _chunkDigits = 0;
+        _state = PARSE_CHUNK_SIZE;
+        return;
+    }
+    if (length) {
+        if (length->valueLen == 0) {
+            fail(400);
+            return;
+        }
+        size_t value = 0;
+        for (size_t i = 0; i < length->valueLen; ++i) {
+            char c = _rawRequest[length->valueStart + i];
+            if (c < '0' || c > '9' || value > (static_cast<size_t>(-1) - 9) / 10) {
+                fail(400);
+                return;
+            }
+            value = value * 10 + (c - '0');
+        }
+        _contentLength = value;
     }
+    if (_contentLength == 0)
+        _complete = true;
+}
 
-    parseQueryString();
+void HTTPRequest::applyBodyLimit(const ServerConfig& config) {
+    const Location* location = config.findLocation(_path);
 
-    if (version != "HTTP/1.1") {
-        Logger::instance().log(ERROR, "Unsupported HTTP version: " + version);
-        return false;
+	if (location) {
+		if (location->clientMaxBodySize != -1)
+	    	_maxBodySize = location->clientMaxBodySize;
+	}
+
+    // Check for request too large
+    if (_maxBodySize > 0 && _contentLength > static_cast<size_t>(_maxBodySize)) {
+        Logger::instance().log(WARNING, "Content-Length exceeds the configured maximum.");
+        _requestTooLarge = true;
+    }
+    // Chunks decoded along with the head were checked against the server limit only
+    if (_chunked && bodyExceedsLimit(0)) {
+        Logger::instance().log(WARNING, "Chunked request body exceeds the configured maximum.");
+        _requestTooLarge = true;
     }
-    return true;
 }
 
 void HTTPRequest::parseQueryString() {
@@ -158,27 +523,8 @@ void HTTPRequest::parseQueryString() {
     }
 }
 
-void HTTPRequest::parseHeaders(const std::string& headers_line) {
-    size_t pos = headers_line.find(":");
-    if (pos != std::string::npos) {
-        std::string key = headers_line.substr(0, pos);
-        std::string value = headers_line.substr(pos + 1);
-        trim(key);
-        trim(value);
-        _headers[key] = value;
-    }
-}
-
 std::string HTTPRequest::getHost() const {
-    std::map<std::string, std::string>::const_iterator it = _headers.find("Host");
-    if (it != _headers.end()) {
-        return it->second;
-    }
-    return "";
-}
-
-void HTTPRequest::parseBody(const std::string& body) {
-    _body = body;
+    return getStrHeader("Host");
 }
 
 std::string HTTPRequest::getMethod() const {
@@ -194,7 +540,12 @@ std::string HTTPRequest::getQueryString() const {
 }
 
 std::map<std::string, std::string> HTTPRequest::getHeaders() const {
-    return _headers;
+    std::map<std::string, std::string> headers;
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        headers[_rawRequest.substr(_fields[i].nameStart, _fields[i].nameLen)] =
+            _rawRequest.substr(_fields[i].valueStart, _fields[i].valueLen);
+    }
+    return headers;
 }
 
 std::string HTTPRequest::getBody() const {
@@ -214,8 +565,11 @@ void HTTPRequest::trim(std::string& s) const {
 std::string HTTPRequest::toStringHeaders() const {
     std::ostringstream oss;
 
-    for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
-        oss << it->first << ": " << it->second << "\r\n";
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        oss.write(_rawRequest.data() + _fields[i].nameStart, _fields[i].nameLen);
+        oss << ": ";
+        oss.write(_rawRequest.data() + _fields[i].valueStart, _fields[i].valueLen);
+        oss << "\r\n";
     }
     return oss.str();
 }
@@ -234,13 +588,19 @@ bool HTTPRequest::getHeadersParsed() const { return _headersParsed; }
 bool HTTPRequest::getRequestTooLarge() const { return _requestTooLarge; }
 size_t HTTPRequest::getContentLength() const { return _contentLength; }
 size_t HTTPRequest::getBodyReceived() const { return _bodyReceived; }
+size_t HTTPRequest::getBodySize() const { return _body.size(); }
+bool HTTPRequest::isChunked() const { return _chunked; }
+
+void HTTPRequest::takeBody(std::string& body) {
+    body.clear();
+    body.swap(_body);
+}
 int HTTPRequest::getMaxBodySize() const { return _maxBodySize; }
 std::string HTTPRequest::getRawRequest() const { return _rawRequest; }
 bool HTTPRequest::getConnectionClosed() const { return _connectionClosed; }
 unsigned long HTTPRequest::getLastActivity() const {return _lastActivity; }
 bool HTTPRequest::isComplete() const { return _complete; }
 
-void HTTPRequest::setBodyReceived(size_t size) { _bodyReceived = size; }
 void HTTPRequest::setRequestTooLarge(bool value) { _requestTooLarge = value; }
 void HTTPRequest::setConnectionClosed(bool value) { _connectionClosed = value; }
 void HTTPRequest::setComplete(bool value) { _complete = value; }
@@ -4,11 +4,21 @@
 #include "ServerConfig.hpp"
 
 #include <string>
+#include <vector>
 #include <map>
 
+#include <sys/types.h>
+
+// Inclusive span of bytes requested with Range
+struct ByteRange {
+	off_t first;
+	off_t last;
+};
 
 class HTTPRequest {
 public:
+	enum RangeStatus { RANGE_NONE, RANGE_SATISFIABLE, RANGE_UNSATISFIABLE };
+
 	HTTPRequest();
 	HTTPRequest(int def_max_body_size);
 	~HTTPRequest();
@@ -20,28 +30,38 @@ public:
 
 	std::string getStrHeader(std::string header) const;
 	bool hasHeader(std::string header) const;
+	// Range header checked against a resource of the given size. RANGE_NONE
+	// when absent, malformed or not worth honoring: the whole resource is sent.
+	RangeStatus getRanges(off_t size, std::vector<ByteRange>& ranges) const;
 
 	std::string getBody() const;
 	std::string getHost() const;
 	void trim(std::string& s) const;
 
-	bool parse();
     std::string toString() const;
     std::string toStringHeaders() const;
-	void parseRawRequest(const ServerConfig& config);
 
-	std::string _rawRequest;
+	// Consumes received bytes, resuming where the previous call stopped.
+	// Returns how many bytes belong to this request.
+	size_t feed(const char* data, size_t len);
+	// Once the headers are parsed: location body limit and 413 check
+	void applyBodyLimit(const ServerConfig& config);
 
 	bool getHeadersParsed() const;
     bool getRequestTooLarge() const;
     size_t getContentLength() const;
+	// Decoded body bytes received so far, including those already taken
 	size_t getBodyReceived() const;
+	// Body bytes held by the request
+	size_t getBodySize() const;
+	bool isChunked() const;
+	// Hands the body received so far over to the caller (CGI stdin)
+	void takeBody(std::string& body);
 	int	getMaxBodySize() const;
 	std::string getRawRequest() const;
 	unsigned long getLastActivity() const;
 
 
-	void setBodyReceived(size_t size);
 	void setRequestTooLarge(bool value);
 
 	bool isComplete() const;
@@ -54,11 +74,58 @@ public:
     void setErrorCode(int code);
 
 private:
+	enum ParseState {
+		PARSE_METHOD,
+		PARSE_TARGET,
+		PARSE_VERSION,
+		PARSE_REQUEST_LINE_LF,
+		PARSE_HEADER_START,
+		PARSE_HEADER_NAME,
+		PARSE_HEADER_VALUE_START,
+		PARSE_HEADER_VALUE,
+		PARSE_HEADER_LF,
+		PARSE_HEADERS_END_LF,
+		PARSE_BODY,
+		// Transfer-Encoding: chunked
+		PARSE_CHUNK_SIZE,
+		PARSE_CHUNK_EXT,
+		PARSE_CHUNK_SIZE_LF,
+		PARSE_CHUNK_DATA,
+		PARSE_CHUNK_DATA_CR,
+		PARSE_CHUNK_DATA_LF,
+		PARSE_TRAILER_START,
+		PARSE_TRAILER_LINE,
+		PARSE_TRAILER_LF,
+		PARSE_TRAILER_END_LF
+	};
+
+	// Header field recorded as offsets into _rawRequest
+	struct HeaderField {
+		size_t nameStart;
+		size_t nameLen;
+		size_t valueStart;
+		size_t valueLen;
+	};
+
+	static const size_t MAX_HEADER_SIZE = 32768;
+
+	// Request line and headers only, the body is stored in _body
+	std::string _rawRequest;
+	ParseState _state;
+	size_t _parsePos;
+	size_t _tokenStart;
+	size_t _valueEnd;
+	HeaderField _field;
+	std::vector<HeaderField> _fields;
+	bool _chunked;
+	size_t _chunkSize;
+	size_t _chunkDigits;
+	size_t _trailerSize;
+
 	std::string _method;
 	std::string _path;
 	std::string _queryString;
 	std::string _body;
-	std::map<std::string, std::string> _headers;
 	bool _complete;
     bool _connectionClosed;
 
@@ -71,10 +138,15 @@ private:
 	unsigned long _lastActivity;
 
 
-	bool parseRequestLine(const std::string& line);
-	void parseHeaders(const std::string& headers);
-	void parseBody(const std::string& body);
+	void parseHead();
+	bool finishRequestLine(size_t versionEnd);
+	void finishHeaders();
+	size_t decodeChunked(const char* data, size_t len);
+	bool endChunkSize();
+	bool bodyExceedsLimit(size_t extra) const;
+	const HeaderField* findField(const std::string& name) const;
 	void parseQueryString();
+	void fail(int code);
 
 	int _errorCode;
 };
@@ -1,13 +1,20 @@
 #include "HTTPResponse.hpp"
 
 #include "Server.hpp"
+#include "OpenFileCache.hpp"
+#include "Compressor.hpp"
 #include "Utils.hpp"
 
+#include <cctype>
 #include <sstream>
 
-HTTPResponse::HTTPResponse() : _statusCode(200), _reasonPhrase("OK") {}
+#include <unistd.h>
 
-HTTPResponse::~HTTPResponse() {}
+HTTPResponse::HTTPResponse() : _statusCode(200), _reasonPhrase("OK"), _file(NULL), _bodyEncoder(NULL), _streamed(false), _streamEnded(false) {}
+
+HTTPResponse::~HTTPResponse() {
+	releaseFileBody();
+}
 
 void HTTPResponse::setStatusCode(int code) {
 	_statusCode = code;
@@ -15,8 +22,10 @@ void HTTPResponse::setStatusCode(int code) {
 		case 200: _reasonPhrase = "OK"; break;
 		case 201: _reasonPhrase = "Created"; break;
 		case 204: _reasonPhrase = "No Content"; break; // requete reussie mais pas de reponse du serveur a renvoyer (genre DELETE)
+		case 206: _reasonPhrase = "Partial Content"; break; // seules les plages demandées (Range) sont envoyées
 		case 301: _reasonPhrase = "Moved Permanently"; break; // indique que la ressource a définitivement été déplacée à l'URL contenue dans l'en-tête Location
 		case 303: _reasonPhrase = "See Other"; break; // renvoyé comme résultat d'une opération PUT ou POST, indique que la redirection ne fait pas le lien vers la ressource nouvellement téléversée mais vers une autre page
+		case 304: _reasonPhrase = "Not Modified"; break; // les validateurs (ETag, date) correspondent : le client garde sa copie
 		case 307: _reasonPhrase = "Temporary Redirect"; break; // indique que la ressource demandée est temporairement déplacée vers l'URL contenue dans l'en-tête Location
 		case 308: _reasonPhrase = "Permanent Redirect"; break; // indique que la ressource demandée à définitivement été déplacée vers l'URL contenue dans l'en-tête Location. Un navigateur redirigera vers cette page et les moteurs de recherche mettront à jour leurs liens vers la ressource
 		case 400: _reasonPhrase = "Bad Request"; break;
@@ -27,8 +36,10 @@ void HTTPResponse::setStatusCode(int code) {
 		case 408: _reasonPhrase = "Request Timeout"; break; // le serveur ne reçoit pas de requête complète dans un délai défini.
 		case 413: _reasonPhrase = "Payload Too Large"; break; // fichier téléchargé dépasse la limite autorisée.
 		case 415: _reasonPhrase = "Unsupported Media Type"; break; // Si certains types de fichiers ne sont pas acceptés.
+		case 416: _reasonPhrase = "Range Not Satisfiable"; break; // aucune des plages demandées (Range) n'est dans le fichier
 		case 418: _reasonPhrase = "I'm a teapot"; break; //?? Where should we implement it ?
 		case 429: _reasonPhrase = "Too Many Requests"; break; // trop grand nombre de requêtes en peu de temps (si limite)
+		case 431: _reasonPhrase = "Request Header Fields Too Large"; break; // en-têtes de la requête trop volumineux
 		case 500: _reasonPhrase = "Internal Server Error"; break;
 		case 501: _reasonPhrase = "Method Not Implemented"; break;
 		case 502: _reasonPhrase = "Bad Gateway"; break; // un serveur (agissant comme une passerelle ou un proxy, style NGINX) a reçu une réponse invalide ou inattendue d'un autre serveur en amont
@@ -97,10 +108,89 @@ void HTTPResponse::setHeader(const std::string& key, const std::string& value) {
 	_headers[key] = value;
 }
 
+static bool sameHeaderName(const std::string& a, const std::string& b) {
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (std::tolower(a[i]) != std::tolower(b[i]))
+			return false;
+	}
+	return true;
+}
+
+void HTTPResponse::removeHeader(const std::string& key) {
+	std::map<std::string, std::string>::iterator it = _headers.begin();
+	while (it != _headers.end()) {
+		if (sameHeaderName(it->first, key))
+			_headers.erase(it++);
+		else
+			++it;
+	}
+}
+
 void HTTPResponse::setBody(const std::string& body) {
+	releaseFileBody();
 	_body = body;
 }
 
+void HTTPResponse::setFileBody(OpenFile* file, off_t offset, size_t length) {
+	std::vector<FileRange> ranges(1);
+	ranges[0].offset = offset;
+	ranges[0].length = length;
+	setFileRanges(file, ranges, "");
+}
+
+void HTTPResponse::setFileRanges(OpenFile* file, const std::vector<FileRange>& ranges, const std::string& trailer) {
+	releaseFileBody();
+	_body.clear();
+	_file = file;
+	_fileRanges = ranges;
+	_fileTrailer = trailer;
+}
+
+void HTTPResponse::releaseFileBody() {
+	if (_file)
+		_file->release();
+	_file = NULL;
+	_fileRanges.clear();
+	_fileTrailer.clear();
+	delete _bodyEncoder;
+	_bodyEncoder = NULL;
+}
+
+void HTTPResponse::setBodyEncoder(Compressor* encoder) {
+	delete _bodyEncoder;
+	_bodyEncoder = encoder;
+}
+
+bool HTTPResponse::hasFileBody() const { return _file != NULL; }
+int HTTPResponse::getFileFd() const { return _file ? _file->getFd() : -1; }
+const std::vector<FileRange>& HTTPResponse::getFileRanges() const { return _fileRanges; }
+const std::string& HTTPResponse::getFileTrailer() const { return _fileTrailer; }
+Compressor* HTTPResponse::getBodyEncoder() const { return _bodyEncoder; }
+
+void HTTPResponse::setStreamBody() {
+	_body.clear();
+	_streamed = true;
+	_streamEnded = false;
+	_stream.clear();
+}
+
+void HTTPResponse::appendStream(const std::string& data) {
+	_stream += data;
+}
+
+void HTTPResponse::takeStream(std::string& data) {
+	data.clear();
+	data.swap(_stream);
+}
+
+void HTTPResponse::endStream() { _streamEnded = true; }
+
+bool HTTPResponse::hasStreamBody() const { return _streamed; }
+bool HTTPResponse::isStreamEnded() const { return _streamEnded; }
+size_t HTTPResponse::getStreamSize() const { return _stream.size(); }
+
 int HTTPResponse::getStatusCode() const {
 	return _statusCode;
 }
@@ -113,7 +203,7 @@ std::map<std::string, std::string> HTTPResponse::getHeaders() const {
 	return _headers;
 }
 
-std::string HTTPResponse::getBody() const {
+const std::string& HTTPResponse::getBody() const {
 	return _body;
 }
 
@@ -124,6 +214,14 @@ std::string HTTPResponse::getStrHeader(std::string header) const {
 	return it->second;
 }
 
+std::string HTTPResponse::findHeader(const std::string& name) const {
+	for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
+		if (sameHeaderName(it->first, name))
+			return it->second;
+	}
+	return "";
+}
+
 std::string HTTPResponse::toStringHeaders() const {
 	std::ostringstream oss;
 	oss << "HTTP/1.1 " << _statusCode << " " << _reasonPhrase << "\r\n";
@@ -155,7 +253,7 @@ void HTTPResponse::parseCGIOutput(const std::string& cgiOutput) {
         setBody(cgiOutput);
     }
     
-    if (this->getStrHeader("Content-Length").empty()) {
+    if (this->findHeader("Content-Length").empty()) {
         this->setHeader("Content-Length", to_string(this->getBody().size()));
     }
 }
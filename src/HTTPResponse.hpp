@@ -3,6 +3,19 @@
 
 #include <string>
 #include <map>
+#include <vector>
+
+#include <sys/types.h>
+
+class OpenFile;
+class Compressor;
+
+// Span of a file body, sent after some bytes from memory (multipart headers)
+struct FileRange {
+    std::string prefix;
+    off_t offset;
+    size_t length;
+};
 
 class HTTPResponse {
 public:
@@ -12,15 +25,39 @@ public:
     void setStatusCode(int code);
     void setReasonPhrase(const std::string& reason);
     void setHeader(const std::string& key, const std::string& value);
+    // Whatever the case of the name, as CGI scripts spell it as they like
+    void removeHeader(const std::string& key);
     void setBody(const std::string& body);
+    // Takes over the caller's reference: the body is sent straight from the file
+    void setFileBody(OpenFile* file, off_t offset, size_t length);
+    // Same, for several spans of the file followed by trailer (multipart/byteranges)
+    void setFileRanges(OpenFile* file, const std::vector<FileRange>& ranges, const std::string& trailer);
+    // Takes ownership: the file body goes through it and is sent chunked
+    void setBodyEncoder(Compressor* encoder);
+    // The body is produced while the response is sent (CGI output): the
+    // producer appends to it and ends it, the connection takes what arrived
+    void setStreamBody();
+    void appendStream(const std::string& data);
+    void takeStream(std::string& data);
+    void endStream();
     HTTPResponse& beError(int err_code, const std::string& errorContent = "");
 
     int getStatusCode() const;
     std::string getReasonPhrase() const;
     std::string generateErrorPage(const std::string& infos = "");
     std::map<std::string, std::string> getHeaders() const;
-    std::string getBody() const;
+    const std::string& getBody() const;
     std::string getStrHeader(std::string header) const;
+    // Same, but matches the name regardless of case, as clients would
+    std::string findHeader(const std::string& name) const;
+    bool hasFileBody() const;
+    int getFileFd() const;
+    const std::vector<FileRange>& getFileRanges() const;
+    const std::string& getFileTrailer() const;
+    Compressor* getBodyEncoder() const;
+    bool hasStreamBody() const;
+    bool isStreamEnded() const;
+    size_t getStreamSize() const;
 
     std::string toString() const;
     std::string toStringHeaders() const;
@@ -34,6 +71,21 @@ private:
     std::string _reasonPhrase;
     std::map<std::string, std::string> _headers;
     std::string _body;
+
+    OpenFile* _file;
+    std::vector<FileRange> _fileRanges;
+    std::string _fileTrailer;
+    Compressor* _bodyEncoder;
+
+    bool _streamed;
+    bool _streamEnded;
+    std::string _stream;
+
+    // Holds a reference on _file
+    HTTPResponse(const HTTPResponse&);
+    HTTPResponse& operator=(const HTTPResponse&);
+
+    void releaseFileBody();
 };
 
 std::string getSorryPath();
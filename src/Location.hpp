@@ -16,10 +16,31 @@ struct Location {
 	std::string uploadPath;
 	bool uploadOn;
 	int autoindex;
+	// On-the-fly compression of responses of these MIME types, from this size on
+	bool gzip;
+	std::vector<std::string> gzipTypes;
+	size_t gzipMinLength;
+	// Serve file.br / file.gz sidecars when the client accepts them
+	bool precompressed;
+	// CGI scripts are run by this FastCGI application instead of a child process
+	std::string fastcgiPass;
+	// CGI scripts running at once (0: no limit), requests waiting beyond that
+	size_t cgiMaxConcurrency;
+	size_t cgiQueueSize;
+	// Micro-cache of CGI responses: default lifetime and stale window in
+	// seconds, byte budget; identical misses wait for a single script
+	bool cgiCache;
+	bool cgiCacheLock;
+	unsigned long cgiCacheValid;
+	unsigned long cgiCacheStale;
+	size_t cgiCacheSize;
 
 	std::map<std::string, std::string> cgiInterpreters;
 
-	Location() : clientMaxBodySize(-1), returnCode(0), uploadOn(false), autoindex(-1) {}
+	Location() : clientMaxBodySize(-1), returnCode(0), uploadOn(false), autoindex(-1), gzip(false), gzipMinLength(256), precompressed(false), cgiMaxConcurrency(0), cgiQueueSize(64), cgiCache(false), cgiCacheLock(true), cgiCacheValid(1), cgiCacheStale(0), cgiCacheSize(1048576) {
+		const char* types[] = {"text/html", "text/css", "text/plain", "application/javascript", "application/json"};
+		gzipTypes.assign(types, types + sizeof(types) / sizeof(types[0]));
+	}
 };
 
 #endif
@@ -0,0 +1,93 @@
+// OpenFileCache.cpp
+#include "OpenFileCache.hpp"
+#include "FileCache.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <unistd.h>
+
+OpenFile::OpenFile(int fd, const struct stat& st)
+    : _fd(fd), _size(st.st_size), _mtime(st.st_mtime), _inode(st.st_ino),
+      _etag(FileCache::makeETag(st)), _lastModified(http_date(st.st_mtime)), _refs(1) {}
+
+OpenFile::~OpenFile() {
+    if (_fd != -1)
+        close(_fd);
+}
+
+int OpenFile::getFd() const { return _fd; }
+off_t OpenFile::getSize() const { return _size; }
+time_t OpenFile::getMtime() const { return _mtime; }
+ino_t OpenFile::getInode() const { return _inode; }
+const std::string& OpenFile::getETag() const { return _etag; }
+const std::string& OpenFile::getLastModified() const { return _lastModified; }
+
+void OpenFile::revalidated(const struct stat& st) {
+    _etag = FileCache::makeETag(st);
+}
+
+void OpenFile::retain() { ++_refs; }
+
+void OpenFile::release() {
+    if (--_refs == 0)
+        delete this;
+}
+
+OpenFileCache::OpenFileCache(size_t maxEntries, unsigned long validMs)
+    : _maxEntries(maxEntries), _validMs(validMs) {}
+
+OpenFileCache::~OpenFileCache() {
+    for (EntryList::iterator it = _entries.begin(); it != _entries.end(); ++it)
+        it->file->release();
+}
+
+void OpenFileCache::erase(EntryList::iterator it) {
+    it->file->release();
+    _index.erase(it->path);
+    _entries.erase(it);
+}
+
+OpenFile* OpenFileCache::acquire(const std::string& path, unsigned long now) {
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(path);
+    if (found == _index.end())
+        return NULL;
+    EntryList::iterator it = found->second;
+
+    if (now - it->validatedAt >= _validMs) {
+        struct stat st;
+        OpenFile* file = it->file;
+        if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode) || st.st_size != file->getSize()
+            || st.st_mtime != file->getMtime() || st.st_ino != file->getInode()) {
+            Logger::instance().log(DEBUG, "Open file cache: " + path + " changed on disk, dropped");
+            erase(it);
+            return NULL;
+        }
+        file->revalidated(st);
+        it->validatedAt = now;
+    }
+    _entries.splice(_entries.begin(), _entries, it);
+    it->file->retain();
+    return it->file;
+}
+
+OpenFile* OpenFileCache::insert(const std::string& path, int fd, const struct stat& st, unsigned long now) {
+    OpenFile* file = new OpenFile(fd, st);
+    if (_maxEntries == 0)
+        return file;
+
+    std::map<std::string, EntryList::iterator>::iterator found = _index.find(path);
+    if (found != _index.end())
+        erase(found->second);
+
+    Entry entry;
+    entry.path = path;
+    entry.file = file;
+    entry.validatedAt = now;
+    _entries.push_front(entry);
+    _index[path] = _entries.begin();
+    file->retain();
+
+    while (_entries.size() > _maxEntries)
+        erase(--_entries.end());
+    return file;
+}
@@ -0,0 +1,79 @@
+// OpenFileCache.hpp
+#ifndef OPENFILECACHE_HPP
+#define OPENFILECACHE_HPP
+
+#include <list>
+#include <map>
+#include <string>
+#include <cstddef>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Open descriptor with its stat metadata, shared by the cache and every
+// response sending it. Closed when the last reference is released.
+class OpenFile {
+public:
+    // The creator holds the first reference
+    OpenFile(int fd, const struct stat& st);
+
+    int getFd() const;
+    off_t getSize() const;
+    time_t getMtime() const;
+    ino_t getInode() const;
+    const std::string& getETag() const;
+    const std::string& getLastModified() const;
+    // The file was found unchanged: a weak ETag may now become strong
+    void revalidated(const struct stat& st);
+
+    void retain();
+    void release();
+
+private:
+    int _fd;
+    off_t _size;
+    time_t _mtime;
+    ino_t _inode;
+    std::string _etag;
+    std::string _lastModified;
+    int _refs;
+
+    ~OpenFile();
+    OpenFile(const OpenFile&);
+    OpenFile& operator=(const OpenFile&);
+};
+
+// LRU of open files keyed by resolved path, revalidated with stat() once
+// validMs has elapsed. Changed files are dropped from the cache; responses
+// already sending them keep their own reference.
+class OpenFileCache {
+public:
+    OpenFileCache(size_t maxEntries, unsigned long validMs);
+    ~OpenFileCache();
+
+    // Returns a new reference for the caller, NULL on a miss
+    OpenFile* acquire(const std::string& path, unsigned long now);
+    // Takes ownership of fd, returns a new reference for the caller
+    OpenFile* insert(const std::string& path, int fd, const struct stat& st, unsigned long now);
+
+private:
+    struct Entry {
+        std::string path;
+        OpenFile* file;
+        unsigned long validatedAt;
+    };
+    typedef std::list<Entry> EntryList;
+
+    size_t _maxEntries;
+    unsigned long _validMs;
+    // Most recently used first
+    EntryList _entries;
+    std::map<std::string, EntryList::iterator> _index;
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+
+    void erase(EntryList::iterator it);
+};
+
+#endif
@@ -0,0 +1,51 @@
+// PollPoller.cpp
+#include "PollPoller.hpp"
+
+PollPoller::PollPoller() {}
+
+PollPoller::~PollPoller() {}
+
+const char* PollPoller::name() const { return "poll"; }
+
+bool PollPoller::registerFd(int fd, short events) {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    if (static_cast<size_t>(fd) >= _positions.size())
+        _positions.resize(fd + 1, 0);
+    _positions[fd] = _fds.size();
+    _fds.push_back(pfd);
+    return true;
+}
+
+bool PollPoller::updateFd(int fd, short events) {
+    _fds[_positions[fd]].events = events;
+    return true;
+}
+
+void PollPoller::unregisterFd(int fd) {
+    size_t pos = _positions[fd];
+    size_t last = _fds.size() - 1;
+    if (pos != last) {
+        _fds[pos] = _fds[last];
+        _positions[_fds[pos].fd] = pos;
+    }
+    _fds.pop_back();
+}
+
+int PollPoller::wait(std::vector<PollerEvent>& ready, int timeout_ms) {
+    ready.clear();
+    int count = poll(_fds.empty() ? NULL : &_fds[0], _fds.size(), timeout_ms);
+    if (count <= 0)
+        return count;
+    for (size_t i = 0; i < _fds.size() && ready.size() < static_cast<size_t>(count); ++i) {
+        if (_fds[i].revents == 0)
+            continue;
+        PollerEvent event;
+        event.fd = _fds[i].fd;
+        event.revents = _fds[i].revents;
+        ready.push_back(event);
+    }
+    return ready.size();
+}
@@ -0,0 +1,31 @@
+// PollPoller.hpp
+#ifndef POLLPOLLER_HPP
+#define POLLPOLLER_HPP
+
+#include "Poller.hpp"
+
+#include <vector>
+
+#include <poll.h>
+
+// Portable backend: keeps a persistent pollfd array, updated in place
+class PollPoller : public Poller {
+public:
+    PollPoller();
+    virtual ~PollPoller();
+
+    virtual int wait(std::vector<PollerEvent>& ready, int timeout_ms);
+    virtual const char* name() const;
+
+protected:
+    virtual bool registerFd(int fd, short events);
+    virtual bool updateFd(int fd, short events);
+    virtual void unregisterFd(int fd);
+
+private:
+    std::vector<pollfd> _fds;
+    // fd -> position in _fds
+    std::vector<size_t> _positions;
+};
+
+#endif
@@ -0,0 +1,83 @@
+// Poller.cpp
+#include "Poller.hpp"
+
+#include "PollPoller.hpp"
+#include "EpollPoller.hpp"
+#include "Logger.hpp"
+
+Poller::Poller() : _count(0) {}
+
+Poller::~Poller() {}
+
+bool Poller::add(int fd, short events) {
+    if (fd < 0)
+        return false;
+    if (isWatched(fd))
+        return modify(fd, events);
+    if (!registerFd(fd, events))
+        return false;
+    if (static_cast<size_t>(fd) >= _interest.size())
+        _interest.resize(fd + 1, -1);
+    _interest[fd] = events;
+    ++_count;
+    return true;
+}
+
+bool Poller::modify(int fd, short events) {
+    if (!isWatched(fd))
+        return add(fd, events);
+    if (_interest[fd] == events)
+        return true;
+    if (!updateFd(fd, events))
+        return false;
+    _interest[fd] = events;
+    return true;
+}
+
+void Poller::remove(int fd) {
+    if (!isWatched(fd))
+        return;
+    unregisterFd(fd);
+    _interest[fd] = -1;
+    --_count;
+}
+
+void Poller::enable(int fd, short events) {
+    if (!isWatched(fd))
+        return;
+    modify(fd, static_cast<short>(_interest[fd] | events));
+}
+
+void Poller::disable(int fd, short events) {
+    if (!isWatched(fd))
+        return;
+    modify(fd, static_cast<short>(_interest[fd] & ~events));
+}
+
+bool Poller::isWatched(int fd) const {
+    return fd >= 0 && static_cast<size_t>(fd) < _interest.size() && _interest[fd] != -1;
+}
+
+short Poller::getEvents(int fd) const {
+    if (!isWatched(fd))
+        return 0;
+    return static_cast<short>(_interest[fd]);
+}
+
+size_t Poller::size() const { return _count; }
+
+Poller* Poller::create(const std::string& backend) {
+#ifdef __linux__
+    if (backend.empty() || backend == "epoll") {
+        EpollPoller* poller = new EpollPoller();
+        if (poller->isValid())
+            return poller;
+        delete poller;
+        Logger::instance().log(WARNING, "epoll unavailable, falling back to poll()");
+    }
+#else
+    if (backend == "epoll")
+        Logger::instance().log(WARNING, "epoll is not supported on this system, falling back to poll()");
+#endif
+    return new PollPoller();
+}
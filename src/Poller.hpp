@@ -0,0 +1,56 @@
+// Poller.hpp
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+// Interest and readiness masks are expressed with the poll(2) constants
+// (POLLIN, POLLOUT, POLLHUP, POLLERR, POLLNVAL) whatever the backend is.
+struct PollerEvent {
+    int fd;
+    short revents;
+};
+
+class Poller {
+public:
+    virtual ~Poller();
+
+    bool add(int fd, short events);
+    bool modify(int fd, short events);
+    void remove(int fd);
+
+    // Incremental interest changes, only hitting the backend when the mask changes
+    void enable(int fd, short events);
+    void disable(int fd, short events);
+
+    bool isWatched(int fd) const;
+    short getEvents(int fd) const;
+    size_t size() const;
+
+    // Fills `ready` with the descriptors that have pending events only
+    virtual int wait(std::vector<PollerEvent>& ready, int timeout_ms) = 0;
+    virtual const char* name() const = 0;
+
+    // backend: "epoll", "poll" or empty for the best one available
+    static Poller* create(const std::string& backend);
+
+protected:
+    Poller();
+
+    virtual bool registerFd(int fd, short events) = 0;
+    virtual bool updateFd(int fd, short events) = 0;
+    virtual void unregisterFd(int fd) = 0;
+
+private:
+    Poller(const Poller&);
+    Poller& operator=(const Poller&);
+
+    // Indexed by fd, -1 when the fd is not watched
+    std::vector<int> _interest;
+    size_t _count;
+};
+
+#endif
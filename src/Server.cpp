@@ -8,9 +8,12 @@
 #include "UploadHandler.hpp"
 #include "Logger.hpp"
 #include "Utils.hpp"
+#include "Compressor.hpp"
 
 #include <sstream>
 #include <fstream>
+#include <cstdio>
+#include <cctype>
 
 #include <fcntl.h>
 #include <time.h>
@@ -20,7 +23,9 @@
 #include <dirent.h>
 #include <sys/stat.h>
 
-Server::Server(const ServerConfig& config) : _config(config) {
+Server::Server(const ServerConfig& config, CGISpawner* spawner)
+    : _config(config), _fileCache(config.fileCacheSize, config.fileCacheMaxFile, config.fileCacheValidMs),
+      _openFiles(config.openFileCacheMax, config.fileCacheValidMs), _spawner(spawner) {
 	if (!_config.isValid()) {
         Logger::instance().log(ERROR, "Server configuration is invalid.");
 	} else {
@@ -28,7 +33,87 @@ Server::Server(const ServerConfig& config) : _config(config) {
 	}
 }
 
-Server::~Server() {}
+Server::~Server() {
+    for (std::map<std::string, FastCGIPool*>::iterator it = _fastcgiPools.begin(); it != _fastcgiPools.end(); ++it)
+        delete it->second;
+    for (std::map<const Location*, CGIQueue*>::iterator it = _cgiQueues.begin(); it != _cgiQueues.end(); ++it)
+        delete it->second;
+    for (std::map<const Location*, CGICache*>::iterator it = _cgiCaches.begin(); it != _cgiCaches.end(); ++it)
+        delete it->second;
+}
+
+FastCGIPool& Server::getFastCGIPool(const std::string& address) {
+    std::map<std::string, FastCGIPool*>::iterator it = _fastcgiPools.find(address);
+    if (it == _fastcgiPools.end())
+        it = _fastcgiPools.insert(std::make_pair(address, new FastCGIPool(address, _config.fastcgiKeepalive))).first;
+    return *it->second;
+}
+
+// NULL when the location does not limit its scripts
+CGIQueue* Server::getCgiQueue(const Location* location) {
+    if (!location || location->cgiMaxConcurrency == 0)
+        return NULL;
+    std::map<const Location*, CGIQueue*>::iterator it = _cgiQueues.find(location);
+    if (it == _cgiQueues.end())
+        it = _cgiQueues.insert(std::make_pair(location, new CGIQueue(location->cgiMaxConcurrency, location->cgiQueueSize))).first;
+    return it->second;
+}
+
+CGICache* Server::getCgiCache(const Location* location) {
+    if (!location || !location->cgiCache)
+        return NULL;
+    std::map<const Location*, CGICache*>::iterator it = _cgiCaches.find(location);
+    if (it == _cgiCaches.end())
+        it = _cgiCaches.insert(std::make_pair(location, new CGICache(location->cgiCacheSize,
+            location->cgiCacheValid * 1000, location->cgiCacheStale * 1000))).first;
+    return it->second;
+}
+
+// True when answered from the cache, or waiting for the response of an
+// identical request. cacheKey is set when the script runs for the others.
+bool Server::lookupCgiCache(int client_fd, ClientConnection& connection, const Location* location, std::string& cacheKey) {
+    HTTPRequest& request = *connection.getRequest();
+    CGICache* cache = getCgiCache(location);
+    // Woken up by the end of the script it waited for
+    connection.setCgiCache(NULL);
+    if (!cache || !CGICache::accepts(request))
+        return false;
+
+    unsigned long now = curr_time_ms();
+    const CachedResponse* cached = NULL;
+    std::string key = CGICache::makeKey(request);
+    CGICache::Status status = cache->lookup(key, now, cached);
+    if (status == CGICache::CACHE_HIT || status == CGICache::CACHE_STALE) {
+        Logger::instance().log(DEBUG, std::string("CGI cache: ") + (status == CGICache::CACHE_HIT ? "hit" : "stale")
+                               + " for " + key);
+        CGICache::fill(*cached, *connection.getResponse(), now);
+    } else if (status == CGICache::CACHE_BUSY && location->cgiCacheLock && cache->join(key, client_fd)) {
+        Logger::instance().log(DEBUG, "CGI cache: waiting for the script running for " + key);
+        connection.setCgiCache(cache);
+        delete connection.getResponse();
+        connection.setResponse(NULL);
+    } else {
+        if (status == CGICache::CACHE_MISS)
+            cacheKey = key;
+        return false;
+    }
+    // Settled while this request waited for a CGI slot
+    if (connection.getCgiQueue()) {
+        connection.getCgiQueue()->cancel(client_fd);
+        connection.setCgiQueue(NULL);
+    }
+    return true;
+}
+
+void Server::collectCgiReady(std::set<int>& pending) {
+    for (std::map<const Location*, CGIQueue*>::const_iterator it = _cgiQueues.begin(); it != _cgiQueues.end(); ++it) {
+        int client_fd = it->second->nextReady();
+        if (client_fd != -1)
+            pending.insert(client_fd);
+    }
+    for (std::map<const Location*, CGICache*>::iterator it = _cgiCaches.begin(); it != _cgiCaches.end(); ++it)
+        it->second->collectReleased(pending);
+}
 
 void setNonBlocking(int fd) {
 	int flags = fcntl(fd, F_GETFL, 0);
@@ -51,57 +136,45 @@ std::string getSorryPath() {
 	return path;
 }
 
-void readFromSocket(int client_fd, HTTPRequest& request) {
+void Server::receiveRequest(int client_fd, ClientConnection& connection) {
+    if (client_fd <= 0) {
+        Logger::instance().log(ERROR, "Invalid client FD before reading: " + to_string(client_fd));
+        return;
+    }
+
     char buffer[1024];
     int bytes_received = read(client_fd, buffer, sizeof(buffer));
 
     if (bytes_received == 0) {
         Logger::instance().log(WARNING, "Client closed the connection: FD " + to_string(client_fd));
-        request.setConnectionClosed(true);
+        connection.getRequest()->setConnectionClosed(true);
     } else if (bytes_received < 0) {
         Logger::instance().log(ERROR, "Error reading from client.");
-        request.setConnectionClosed(true);
+        connection.getRequest()->setConnectionClosed(true);
     } else {
-        request._rawRequest.append(buffer, bytes_received);
+        feedRequest(connection, buffer, bytes_received);
     }
 }
 
+void Server::feedRequest(ClientConnection& connection, const char* data, size_t len) {
+    HTTPRequest& request = *connection.getRequest();
+    bool headersParsed = request.getHeadersParsed();
 
-void Server::receiveRequest(int client_fd, HTTPRequest& request) {
-    if (client_fd <= 0) {
-        Logger::instance().log(ERROR, "Invalid client FD before reading: " + to_string(client_fd));
-        return;
-    }
+    size_t consumed = request.feed(data, len);
+    // Anything past the end of this request belongs to the next pipelined one
+    if (consumed < len)
+        connection.bufferInput(data + consumed, len - consumed);
 
-    readFromSocket(client_fd, request);
-    if (!request.getHeadersParsed()) {
-        request.parseRawRequest(_config);
-        if (request.getRequestTooLarge()) {
-			request.setErrorCode(413);
-            return;
-        }
-    }
+    if (request.getErrorCode() != 0)
+        return;
+    if (!headersParsed && request.getHeadersParsed())
+        request.applyBodyLimit(_config);
     if (request.getRequestTooLarge()) {
 		request.setErrorCode(413);
         return;
     }
-    if (request.getHeadersParsed()) {
-        size_t header_end_pos = request._rawRequest.find("\r\n\r\n") + 4;
-        request.setBodyReceived(request._rawRequest.size() - header_end_pos);
-        // Check if full body is received
-        if (request.getBodyReceived() >= request.getContentLength()) {
-            request.setComplete(true);
-            Logger::instance().log(INFO, "Full request read.");
-            return;
-        }
-        // Check if body size exceeds maximum
-        if (request.getBodyReceived() > static_cast<size_t>(request.getMaxBodySize()) && request.getMaxBodySize()) {
-            Logger::instance().log(WARNING, "Request body size exceeds the configured maximum.");
-            request.setRequestTooLarge(true);
-			request.setErrorCode(413);
-            return;
-        }
-    }
+    if (request.isComplete())
+        Logger::instance().log(INFO, "Full request read.");
 }
 
 void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
@@ -116,6 +189,7 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
     session.getManager(&request, response, client_fd, session);
 
     const Location* location = _config.findLocation(request.getPath());
+    connection.setEncodingContext(location, request.getStrHeader("Accept-Encoding"));
 
     if (location && !location->allowedMethods.empty()) {
         if (std::find(location->allowedMethods.begin(), location->allowedMethods.end(), request.getMethod()) == location->allowedMethods.end()) {
@@ -163,8 +237,11 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
     response = connection.getResponse();
 
     std::string connectionHeader = request.getStrHeader("Connection");
-    delete connection.getRequest();
-    connection.setRequest(NULL);
+    // A running CGI still reads its body from the request
+    if (!connection.getCgiHandler() && !connection.getCgiQueue() && !connection.getCgiCache()) {
+        delete connection.getRequest();
+        connection.setRequest(NULL);
+    }
     bool keepAlive = true;
     // En HTTP/1.1, keep-alive par défaut sauf si Connection: close
     if (!connectionHeader.empty() && (connectionHeader == "close" || connectionHeader == "Close")) {
@@ -177,10 +254,95 @@ void Server::handleHttpRequest(int client_fd, ClientConnection& connection) {
         response->setHeader("Connection", "close");
     }
 
-    // Ajouter Content-Length si absent
-    if (response && response->getStrHeader("Content-Length").empty()) {
+    // Ajouter Content-Length si absent (jamais sur un 304, qui n'a pas de corps)
+    if (response && response->getStatusCode() != 304 && response->findHeader("Content-Length").empty()) {
         response->setHeader("Content-Length", to_string(response->getBody().size()));
     }
+    encodeResponse(connection);
+}
+
+// q-value given to a content coding by Accept-Encoding, -1 if not acceptable
+static double codingQuality(const std::string& header, const std::string& name) {
+    double q = -1, anyQ = -1;
+    std::istringstream entries(header);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        std::string coding = entry.substr(0, entry.find(';'));
+        coding.erase(0, coding.find_first_not_of(" \t"));
+        coding.erase(coding.find_last_not_of(" \t") + 1);
+        for (size_t i = 0; i < coding.size(); ++i)
+            coding[i] = std::tolower(static_cast<unsigned char>(coding[i]));
+        double value = 1;
+        size_t qPos = entry.find("q=");
+        if (qPos != std::string::npos)
+            value = std::strtod(entry.c_str() + qPos + 2, NULL);
+        if (coding == name || (name == "gzip" && coding == "x-gzip"))
+            q = value;
+        else if (coding == "*")
+            anyQ = value;
+    }
+    q = q < 0 ? anyQ : q;
+    return q > 0 ? q : -1;
+}
+
+// Picks gzip or deflate, whichever has the higher q-value
+static bool negotiateEncoding(const std::string& header, Compressor::Format& format) {
+    double gzipQ = codingQuality(header, "gzip");
+    double deflateQ = codingQuality(header, "deflate");
+    if (gzipQ < 0 && deflateQ < 0)
+        return false;
+    format = gzipQ >= deflateQ ? Compressor::GZIP : Compressor::DEFLATE;
+    return true;
+}
+
+void Server::encodeResponse(ClientConnection& connection) {
+    HTTPResponse* response = connection.getResponse();
+    const Location* location = connection.getLocation();
+    // Partial, bodiless and error responses are always sent as they are
+    if (!response || !location || !location->gzip || response->getStatusCode() != 200
+        || !response->findHeader("Content-Encoding").empty())
+        return;
+
+    std::string type = response->findHeader("Content-Type");
+    type = type.substr(0, type.find(';'));
+    type.erase(type.find_last_not_of(" \t") + 1);
+    if (std::find(location->gzipTypes.begin(), location->gzipTypes.end(), type) == location->gzipTypes.end())
+        return;
+    // The representation depends on Accept-Encoding, even when sent uncompressed
+    response->setHeader("Vary", "Accept-Encoding");
+
+    Compressor::Format format;
+    if (!negotiateEncoding(connection.getAcceptEncoding(), format))
+        return;
+    size_t length = response->hasFileBody() ? response->getFileRanges()[0].length : response->getBody().size();
+    if (response->hasStreamBody()) {
+        // Still being produced: only a Content-Length from the script tells its size
+        std::string contentLength = response->findHeader("Content-Length");
+        length = contentLength.empty() ? location->gzipMinLength : std::strtoul(contentLength.c_str(), NULL, 10);
+    }
+    if (length < location->gzipMinLength)
+        return;
+
+    // Byte ranges and strong validators refer to the identity representation
+    std::string etag = response->findHeader("ETag");
+    if (!etag.empty() && etag[0] == '"') {
+        response->removeHeader("ETag");
+        response->setHeader("ETag", "W/" + etag);
+    }
+    response->removeHeader("Accept-Ranges");
+
+    if (response->hasFileBody() || response->hasStreamBody()) {
+        response->setBodyEncoder(new Compressor(format));
+        response->removeHeader("Content-Length");
+        response->setHeader("Transfer-Encoding", "chunked");
+    } else {
+        std::string compressed;
+        if (!Compressor::compressAll(format, response->getBody(), compressed))
+            return;
+        response->setBody(compressed);
+        response->setHeader("Content-Length", to_string(compressed.size()));
+    }
+    response->setHeader("Content-Encoding", Compressor::name(format));
 }
 
 bool Server::hasCgiExtension(const std::string& extension) const {
@@ -273,12 +435,7 @@ void Server::handleFileUpload(const HTTPRequest& request, HTTPResponse& response
 }
 
 
-void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection) {
-    HTTPRequest& request = *connection.getRequest();
-    HTTPResponse& response = *connection.getResponse();
-
-    const Location* location = _config.findLocation(request.getPath());
-
+std::string Server::resolvePath(const HTTPRequest& request, const Location* location) const {
     std::string root = _config.root;
     if (location && !location->root.empty()) {
         root = location->root;
@@ -295,7 +452,24 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
         pathUnderRoot = "/" + pathUnderRoot;
     }
 
-    std::string fullPath = root + pathUnderRoot;
+    return root + pathUnderRoot;
+}
+
+bool Server::streamsRequestBody(const HTTPRequest& request) const {
+    // A chunked body is buffered: CONTENT_LENGTH must be known before the script starts
+    if (!request.getHeadersParsed() || request.isChunked() || request.getMethod() != "POST"
+        || request.getStrHeader("Content-Type").find("multipart/form-data") != std::string::npos)
+        return false;
+    const Location* location = _config.findLocation(request.getPath());
+    return hasCgiExtension(getFileExtension(resolvePath(request, location)));
+}
+
+void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection) {
+    HTTPRequest& request = *connection.getRequest();
+    HTTPResponse& response = *connection.getResponse();
+
+    const Location* location = _config.findLocation(request.getPath());
+    std::string fullPath = resolvePath(request, location);
 
     if (request.getMethod() != "GET" && request.getMethod() != "POST" && request.getMethod() != "DELETE") {
         response.beError(501); // Not Implemented
@@ -336,8 +510,9 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
     if (hasCgiExtension(extension)) {
         Logger::instance().log(DEBUG, "CGI extension detected for path: " + fullPath);
 
-        std::string interpreter = getInterpreterForExtension(extension, location);
-        if (interpreter.empty()) {
+        bool fastcgi = location && !location->fastcgiPass.empty();
+        std::string interpreter = fastcgi ? "" : getInterpreterForExtension(extension, location);
+        if (!fastcgi && interpreter.empty()) {
             Logger::instance().log(ERROR, "No interpreter found for extension: " + extension);
             response.beError(500, "No interpreter configured for this CGI extension.");
             return;
@@ -347,9 +522,41 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
             Logger::instance().log(DEBUG, "CGI script not found: " + fullPath);
             response.beError(404); // Not Found
         } else {
+            std::string cacheKey;
+            if (lookupCgiCache(client_fd, connection, location, cacheKey))
+                return;
+            CGIQueue* queue = getCgiQueue(location);
+            CGIQueue::Admission admission = queue ? queue->admit(client_fd) : CGIQueue::CGI_START;
+            // Not run now: another request may run the script for the key
+            if (admission != CGIQueue::CGI_START && !cacheKey.empty())
+                getCgiCache(location)->release(cacheKey);
+            if (admission == CGIQueue::CGI_REJECT) {
+                Logger::instance().log(WARNING, "503 error: CGI queue full for location " + location->path);
+                response.beError(503, "Too many CGI requests");
+                response.setHeader("Retry-After", to_string(CGIQueue::RETRY_AFTER_SECONDS));
+                return;
+            }
+            if (admission == CGIQueue::CGI_WAIT) {
+                // Handled again by the event loop once a slot is free
+                connection.setCgiQueue(queue);
+                delete connection.getResponse();
+                connection.setResponse(NULL);
+                return;
+            }
+            connection.setCgiQueue(NULL);
             CGIHandler* cgiHandler = new CGIHandler(fullPath, interpreter, request);
+            // A handler failing to start gives its slot back when deleted
+            cgiHandler->setQueue(queue);
+            if (!cacheKey.empty())
+                cgiHandler->recordFor(getCgiCache(location), cacheKey);
             connection.setCgiHandler(cgiHandler);
-            if (!cgiHandler->startCGI()) {
+            if (fastcgi && !cgiHandler->startFastCGI(getFastCGIPool(location->fastcgiPass))) {
+                delete cgiHandler;
+                connection.setCgiHandler(NULL);
+                response.beError(502, "FastCGI application unavailable");
+            } else if (!fastcgi && !cgiHandler->startCGI(_spawner)) {
+                delete cgiHandler;
+                connection.setCgiHandler(NULL);
                 response.beError(500, "Unable to start CGI Process");
             } else {
                 if (connection.getResponse())
@@ -374,96 +581,378 @@ void Server::handleGetOrPostRequest(int client_fd, ClientConnection& connection)
 void Server::handleDeleteRequest(ClientConnection& connection) {
     const HTTPRequest& request = *connection.getRequest();
 	std::string fullPath = _config.root + request.getPath();
-	HTTPResponse response;
+	HTTPResponse* response = new HTTPResponse();
 	if (access(fullPath.c_str(), F_OK) == -1) {
         Logger::instance().log(WARNING, "404 error (Not Found) sent on DELETE request for address: \n" + _config.root + request.getPath());
-		response.beError(404);
+		response->beError(404);
 	} else if (access(fullPath.c_str(), W_OK) == -1) {
         Logger::instance().log(WARNING, "403 Forbidden on DELETE request for: " + fullPath);
-        response.beError(403, "No permission to delete file : " + request.getPath());
+        response->beError(403, "No permission to delete file : " + request.getPath());
     } else {
 		if (remove(fullPath.c_str()) == 0) {
-			response.setStatusCode(204);
-			response.setHeader("Content-Type", "text/html");
+			response->setStatusCode(204);
+			response->setHeader("Content-Type", "text/html");
 			std::string body = "<html><body><h1>File deleted successfully</h1></body></html>";
-			response.setHeader("Content-Length", to_string(body.size()));
-			response.setBody(body);
+			response->setHeader("Content-Length", to_string(body.size()));
+			response->setBody(body);
             Logger::instance().log(INFO, "Successful DELETE on resource : " + fullPath);
 		} else {
             Logger::instance().log(WARNING, "500 error (Internal Server Error) to DELETE: " + fullPath + ": remove() failed");
-			response.beError(500);
+			response->beError(500);
 		}
 	}
     if (connection.getResponse())
         delete connection.getResponse();
-    connection.setResponse(new HTTPResponse(response));
+    connection.setResponse(response);
 }
 
-void Server::serveStaticFile(int client_fd, const std::string& filePath,
-                             HTTPResponse& response, const HTTPRequest& request) {
-    struct stat pathStat;
-    if (stat(filePath.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
-        Logger::instance().log(INFO, "Request File Path is a directory, searching for an index page...");
-        std::string indexPath = filePath + "/" + _config.index;
-        if (access(indexPath.c_str(), F_OK) != -1) {
-            Logger::instance().log(INFO, "Found index page: " + indexPath);
-            serveStaticFile(client_fd, indexPath, response, request);
-        } else {
-            bool autoindex = _config.autoindex;
-            const Location* location = _config.findLocation(request.getPath());
-            if (location && location->autoindex != -1) {
-                autoindex = (location->autoindex == 1);
-            }
+std::string Server::getContentType(const std::string& filePath) const {
+    size_t extPos = filePath.find_last_of('.');
+    if (extPos == std::string::npos)
+        return "text/html";
+    std::string extension = filePath.substr(extPos);
+    if (extension == ".css")
+        return "text/css";
+    else if (extension == ".js")
+        return "application/javascript";
+    else if (extension == ".png")
+        return "image/png";
+    else if (extension == ".jpg" || extension == ".jpeg")
+        return "image/jpeg";
+    else if (extension == ".gif")
+        return "image/gif";
+    return "text/html";
+}
 
-            if (autoindex) {
-                Logger::instance().log(INFO, "Index page not found. Generating directory listing for: " + filePath);
-                std::string directoryListing = generateDirectoryListing(filePath, request.getPath());
+// Weak comparison (RFC 9110 8.8.3.2): the W/ prefix is ignored on both sides
+static bool etagMatches(const std::string& header, const std::string& etag) {
+    std::string opaque = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t comma = header.find(',', pos);
+        if (comma == std::string::npos)
+            comma = header.size();
+        size_t start = header.find_first_not_of(" \t", pos);
+        size_t end = header.find_last_not_of(" \t", comma - 1);
+        if (start != std::string::npos && start < comma && end >= start) {
+            std::string candidate = header.substr(start, end - start + 1);
+            if (candidate.compare(0, 2, "W/") == 0)
+                candidate.erase(0, 2);
+            if (candidate == "*" || candidate == opaque)
+                return true;
+        }
+        pos = comma + 1;
+    }
+    return false;
+}
+
+bool Server::isNotModified(const HTTPRequest& request, const std::string& etag, time_t mtime) const {
+    if (request.getMethod() != "GET")
+        return false;
+    // If-Modified-Since is ignored when If-None-Match is present
+    if (request.hasHeader("If-None-Match"))
+        return etagMatches(request.getStrHeader("If-None-Match"), etag);
+    time_t since;
+    if (request.hasHeader("If-Modified-Since")
+        && parse_http_date(request.getStrHeader("If-Modified-Since"), since))
+        return mtime <= since;
+    return false;
+}
+
+void Server::setNotModified(HTTPResponse& response, const std::string& etag, const std::string& lastModified) {
+    response.setStatusCode(304);
+    response.setHeader("ETag", etag);
+    response.setHeader("Last-Modified", lastModified);
+    response.setBody("");
+}
+
+// If-Range: the range is only honored if the file is still the one the client has
+static bool ifRangeMatches(const HTTPRequest& request, const std::string& etag, time_t mtime) {
+    if (!request.hasHeader("If-Range"))
+        return true;
+    std::string value = request.getStrHeader("If-Range");
+    if (!value.empty() && (value[0] == '"' || value.compare(0, 2, "W/") == 0))
+        return value == etag && etag.compare(0, 2, "W/") != 0; // Strong comparison
+    time_t date;
+    return parse_http_date(value, date) && date == mtime;
+}
+
+HTTPRequest::RangeStatus Server::resolveRanges(const HTTPRequest& request, off_t size, const std::string& etag,
+                                               time_t mtime, std::vector<ByteRange>& ranges) const {
+    if (request.getMethod() != "GET" || !ifRangeMatches(request, etag, mtime))
+        return HTTPRequest::RANGE_NONE;
+    return request.getRanges(size, ranges);
+}
+
+void Server::setRangeNotSatisfiable(HTTPResponse& response, off_t size) {
+    response.beError(416);
+    response.setHeader("Content-Range", "bytes */" + to_string(size));
+}
+
+static std::string contentRange(const ByteRange& range, off_t size) {
+    return "bytes " + to_string(range.first) + "-" + to_string(range.last) + "/" + to_string(size);
+}
+
+// multipart/byteranges framing: one header block per range, then the closing
+// delimiter. Returns the Content-Type of the whole response.
+static std::string frameRanges(const std::vector<ByteRange>& ranges, const std::string& contentType, off_t size,
+                               std::vector<FileRange>& parts, std::string& trailer) {
+    std::string boundary = "webserv";
+    for (int i = 0; i < 4; ++i) {
+        char hex[8];
+        snprintf(hex, sizeof(hex), "%04x", rand() & 0xffff);
+        boundary += hex;
+    }
+    parts.resize(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        parts[i].prefix = "\r\n--" + boundary + "\r\nContent-Type: " + contentType
+            + "\r\nContent-Range: " + contentRange(ranges[i], size) + "\r\n\r\n";
+        parts[i].offset = ranges[i].first;
+        parts[i].length = ranges[i].last - ranges[i].first + 1;
+    }
+    trailer = "\r\n--" + boundary + "--\r\n";
+    return "multipart/byteranges; boundary=" + boundary;
+}
+
+static size_t framedLength(const std::vector<FileRange>& parts, const std::string& trailer) {
+    size_t length = trailer.size();
+    for (size_t i = 0; i < parts.size(); ++i)
+        length += parts[i].prefix.size() + parts[i].length;
+    return length;
+}
+
+// The type comes from filePath: a sidecar is served with the type of the file it encodes
+void Server::serveCachedFile(const CachedFile& file, const std::string& filePath, const HTTPRequest& request, HTTPResponse& response) {
+    if (isNotModified(request, file.etag, file.mtime)) {
+        setNotModified(response, file.etag, file.lastModified);
+        return;
+    }
+    std::vector<ByteRange> ranges;
+    HTTPRequest::RangeStatus status = resolveRanges(request, file.size, file.etag, file.mtime, ranges);
+    if (status == HTTPRequest::RANGE_UNSATISFIABLE) {
+        setRangeNotSatisfiable(response, file.size);
+        return;
+    }
+
+    std::string contentType = getContentType(filePath);
+    response.setHeader("ETag", file.etag);
+    response.setHeader("Last-Modified", file.lastModified);
+    response.setHeader("Accept-Ranges", "bytes");
+    if (status == HTTPRequest::RANGE_NONE) {
+        response.setStatusCode(200);
+        response.setHeader("Content-Type", contentType);
+        response.setHeader("Content-Length", file.contentLength);
+        response.setBody(file.body);
+        return;
+    }
+
+    response.setStatusCode(206);
+    if (ranges.size() == 1) {
+        size_t length = ranges[0].last - ranges[0].first + 1;
+        response.setHeader("Content-Type", contentType);
+        response.setHeader("Content-Range", contentRange(ranges[0], file.size));
+        response.setHeader("Content-Length", to_string(length));
+        response.setBody(file.body.substr(ranges[0].first, length));
+        return;
+    }
+    std::vector<FileRange> parts;
+    std::string trailer;
+    response.setHeader("Content-Type", frameRanges(ranges, contentType, file.size, parts, trailer));
+    std::string body;
+    body.reserve(framedLength(parts, trailer));
+    for (size_t i = 0; i < parts.size(); ++i) {
+        body += parts[i].prefix;
+        body.append(file.body, parts[i].offset, parts[i].length);
+    }
+    body += trailer;
+    response.setHeader("Content-Length", to_string(body.size()));
+    response.setBody(body);
+}
+
+void Server::serveOpenFile(OpenFile* file, const std::string& filePath, const HTTPRequest& request, HTTPResponse& response) {
+    if (isNotModified(request, file->getETag(), file->getMtime())) {
+        setNotModified(response, file->getETag(), file->getLastModified());
+        file->release();
+        return;
+    }
+    std::vector<ByteRange> ranges;
+    HTTPRequest::RangeStatus status = resolveRanges(request, file->getSize(), file->getETag(), file->getMtime(), ranges);
+    if (status == HTTPRequest::RANGE_UNSATISFIABLE) {
+        setRangeNotSatisfiable(response, file->getSize());
+        file->release();
+        return;
+    }
+
+    std::string contentType = getContentType(filePath);
+    response.setHeader("ETag", file->getETag());
+    response.setHeader("Last-Modified", file->getLastModified());
+    response.setHeader("Accept-Ranges", "bytes");
+    // Sent from the file by the kernel, never loaded in memory
+    if (status == HTTPRequest::RANGE_NONE) {
+        response.setStatusCode(200);
+        response.setHeader("Content-Type", contentType);
+        response.setHeader("Content-Length", to_string(file->getSize()));
+        response.setFileBody(file, 0, file->getSize());
+        return;
+    }
+
+    response.setStatusCode(206);
+    if (ranges.size() == 1) {
+        size_t length = ranges[0].last - ranges[0].first + 1;
+        response.setHeader("Content-Type", contentType);
+        response.setHeader("Content-Range", contentRange(ranges[0], file->getSize()));
+        response.setHeader("Content-Length", to_string(length));
+        response.setFileBody(file, ranges[0].first, length);
+        return;
+    }
+    std::vector<FileRange> parts;
+    std::string trailer;
+    response.setHeader("Content-Type", frameRanges(ranges, contentType, file->getSize(), parts, trailer));
+    response.setHeader("Content-Length", to_string(framedLength(parts, trailer)));
+    response.setFileRanges(file, parts, trailer);
+}
 
-                response.setStatusCode(200);
-                response.setHeader("Content-Type", "text/html");
-                response.setBody(directoryListing);
-                response.setHeader("Content-Length", to_string(directoryListing.size()));
+// Regular file from the caches, opened and cached on a miss. On success exactly
+// one of cached and file is set; file is a new reference for the caller.
+bool Server::openStaticFile(const std::string& path, unsigned long now, const CachedFile*& cached, OpenFile*& file) {
+    file = NULL;
+    cached = _fileCache.lookup(path, now);
+    if (cached)
+        return true;
+    file = _openFiles.acquire(path, now);
+    if (file)
+        return true;
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return false;
+    }
+    if (_fileCache.accepts(fileStat.st_size)) {
+        cached = _fileCache.insert(path, fd, fileStat, now);
+        if (cached) {
+            close(fd);
+            return true;
+        }
+    }
+    file = _openFiles.insert(path, fd, fileStat, now);
+    return true;
+}
+
+// path.br / path.gz, if the client accepts it and it is not older than path
+bool Server::serveSidecar(const std::string& path, time_t mtime, const HTTPRequest& request,
+                          HTTPResponse& response, unsigned long now) {
+    const Location* location = _config.findLocation(request.getPath());
+    if (!location || !location->precompressed || request.getMethod() != "GET")
+        return false;
+    response.setHeader("Vary", "Accept-Encoding");
+
+    std::string acceptEncoding = request.getStrHeader("Accept-Encoding");
+    double brQ = codingQuality(acceptEncoding, "br");
+    double gzipQ = codingQuality(acceptEncoding, "gzip");
+    const char* codings[2] = { "br", "gzip" };
+    const char* extensions[2] = { ".br", ".gz" };
+    double qualities[2] = { brQ, gzipQ };
+    int first = brQ >= gzipQ ? 0 : 1;
+
+    for (int i = 0; i < 2; ++i) {
+        int candidate = (first + i) % 2;
+        if (qualities[candidate] < 0)
+            continue;
+        const CachedFile* cached;
+        OpenFile* file;
+        if (!openStaticFile(path + extensions[candidate], now, cached, file))
+            continue;
+        if ((cached ? cached->mtime : file->getMtime()) < mtime) {
+            Logger::instance().log(DEBUG, "Ignoring stale " + path + extensions[candidate]);
+            if (file)
+                file->release();
+            continue;
+        }
+        Logger::instance().log(DEBUG, "Serving precompressed " + path + extensions[candidate]);
+        if (cached)
+            serveCachedFile(*cached, path, request, response);
+        else
+            serveOpenFile(file, path, request, response);
+        if (response.getStatusCode() == 200 || response.getStatusCode() == 206)
+            response.setHeader("Content-Encoding", codings[candidate]);
+        return true;
+    }
+    return false;
+}
+
+void Server::serveStaticFile(int client_fd, const std::string& filePath,
+                             HTTPResponse& response, const HTTPRequest& request) {
+    unsigned long now = curr_time_ms();
+    // Hot files, directory index pages and large files already open are
+    // served without touching the disk
+    const CachedFile* cached = _fileCache.lookup(filePath, now);
+    OpenFile* file = NULL;
+    if (!cached)
+        cached = _fileCache.lookup(filePath + "/" + _config.index, now);
+    if (!cached)
+        file = _openFiles.acquire(filePath, now);
+
+    if (!cached && !file) {
+        struct stat pathStat;
+        if (stat(filePath.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
+            Logger::instance().log(INFO, "Request File Path is a directory, searching for an index page...");
+            std::string indexPath = filePath + "/" + _config.index;
+            if (access(indexPath.c_str(), F_OK) != -1) {
+                Logger::instance().log(INFO, "Found index page: " + indexPath);
+                serveStaticFile(client_fd, indexPath, response, request);
             } else {
-                Logger::instance().log(INFO, "Index page not found and autoindex is off. Sending 403 Forbidden.");
-                response.beError(403);//Forbidden
+                bool autoindex = _config.autoindex;
+                const Location* location = _config.findLocation(request.getPath());
+                if (location && location->autoindex != -1) {
+                    autoindex = (location->autoindex == 1);
+                }
+
+                if (autoindex) {
+                    Logger::instance().log(INFO, "Index page not found. Generating directory listing for: " + filePath);
+                    std::string directoryListing = generateDirectoryListing(filePath, request.getPath());
+
+                    response.setStatusCode(200);
+                    response.setHeader("Content-Type", "text/html");
+                    response.setBody(directoryListing);
+                    response.setHeader("Content-Length", to_string(directoryListing.size()));
+                } else {
+                    Logger::instance().log(INFO, "Index page not found and autoindex is off. Sending 403 Forbidden.");
+                    response.beError(403);//Forbidden
+                }
             }
+            return;
         }
-    } else {
-        std::ifstream file(filePath.c_str(), std::ios::binary);
-        if (file) {
-            Logger::instance().log(INFO, "Serving static file found at: " + filePath);
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            std::string content = buffer.str();
-
-            response.setStatusCode(200);
-            response.setReasonPhrase("OK");
-
-            std::string contentType = "text/html";
-            size_t extPos = filePath.find_last_of('.');
-            if (extPos != std::string::npos) {
-                std::string extension = filePath.substr(extPos);
-                if (extension == ".css")
-                    contentType = "text/css";
-                else if (extension == ".js")
-                    contentType = "application/javascript";
-                else if (extension == ".png")
-                    contentType = "image/png";
-                else if (extension == ".jpg" || extension == ".jpeg")
-                    contentType = "image/jpeg";
-                else if (extension == ".gif")
-                    contentType = "image/gif";
-            }
-
-            response.setHeader("Content-Type", contentType);
-            response.setHeader("Content-Length", to_string(content.size()));
-            response.setBody(content);
-            Logger::instance().log(DEBUG, "Set-Cookie header: " + response.getStrHeader("Set-Cookie"));
-        } else {
+        if (!openStaticFile(filePath, now, cached, file)) {
             Logger::instance().log(WARNING, "Requested file not found: " + filePath + "; 404 error sent");
             response.beError(404);
+            return;
         }
+        Logger::instance().log(INFO, "Serving static file found at: " + filePath);
     }
+
+    std::string path = cached ? cached->path : filePath;
+    if (serveSidecar(path, cached ? cached->mtime : file->getMtime(), request, response, now)) {
+        if (file)
+            file->release();
+        return;
+    }
+    if (file) {
+        serveOpenFile(file, path, request, response);
+        return;
+    }
+    // Caching a sidecar may have evicted the entry
+    if (!(cached = _fileCache.lookup(path, now)) && !openStaticFile(path, now, cached, file)) {
+        response.beError(404);
+        return;
+    }
+    if (cached)
+        serveCachedFile(*cached, path, request, response);
+    else
+        serveOpenFile(file, path, request, response);
 }
 
 int Server::acceptNewClient(int server_fd) {
@@ -482,6 +971,7 @@ int Server::acceptNewClient(int server_fd) {
 		return -1;
 	}
     setNonBlocking(client_fd);
+    set_close_on_exec(client_fd);
 	return client_fd;
 }
 
@@ -494,27 +984,36 @@ void Server::handleClient(int client_fd, ClientConnection& connection) {
     if (!connection.getRequest())
         connection.setRequest(new HTTPRequest(connection.getServer()->getConfig().clientMaxBodySize));
 
-    receiveRequest(client_fd, *connection.getRequest());
+    receiveRequest(client_fd, connection);
+    rejectInvalidRequest(connection);
+}
+
+// Parses the next request from bytes that arrived with the previous one
+void Server::handlePipelinedRequest(ClientConnection& connection) {
+    std::string input;
+    connection.takeBufferedInput(input);
+
+    if (!connection.getRequest())
+        connection.setRequest(new HTTPRequest(connection.getServer()->getConfig().clientMaxBodySize));
 
+    feedRequest(connection, input.data(), input.size());
+    rejectInvalidRequest(connection);
+}
+
+void Server::rejectInvalidRequest(ClientConnection& connection) {
+	// The event loop stops the script before answering
+	if (connection.getCgiHandler())
+		return;
 	if (connection.getRequest()->getErrorCode() != 0) {
         HTTPResponse* errorResponse = new HTTPResponse();
         errorResponse->beError(connection.getRequest()->getErrorCode());
+        // The rest of the stream cannot be framed anymore
+        errorResponse->setHeader("Connection", "close");
         if (connection.getResponse())
             delete connection.getResponse();
         connection.setResponse(errorResponse);
         connection.prepareResponse();
-        return;
-    }
-    if (!connection.getRequest()->isComplete()) {
-        // Request is incomplete, return and wait for more data
-        return;
     }
-    if (!connection.getRequest()->parse()) {
-        Logger::instance().log(ERROR, "Failed to parse client request on fd " + to_string(client_fd));
-        connection.getRequest()->setErrorCode(400);  // Bad Request
-        return;
-    }
-
 }
 
 void Server::handleResponseSending(int client_fd, ClientConnection& connection) {
@@ -531,19 +1030,14 @@ void Server::handleResponseSending(int client_fd, ClientConnection& connection)
 
         if (connHeader == "close") {
             Logger::instance().log(INFO, "Response fully sent, closing connection FD: " + to_string(client_fd));
+            connection.setCloseRequested(true);
         } else {
             Logger::instance().log(INFO, "Response fully sent, keeping connection alive FD: " + to_string(client_fd));
-
-            int max_body_size = connection.getServer()->getConfig().clientMaxBodySize;
-            if (connection.getRequest())
-            {
-                delete connection.getRequest();
-            }
-            connection.setRequest(new HTTPRequest(max_body_size));
         }
         connection.setExchangeOver(true);
     } else if (completed == -1) {
         Logger::instance().log(ERROR, "Error while writing to client fd :" + to_string(client_fd) + ". Closing Connection");
+        connection.setCloseRequested(true);
         connection.setExchangeOver(true);
     }
 }
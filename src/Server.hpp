@@ -9,9 +9,16 @@
 #include "HTTPResponse.hpp"
 #include "SessionManager.hpp"
 #include "ClientConnection.hpp"
+#include "FileCache.hpp"
+#include "OpenFileCache.hpp"
+#include "FastCGIPool.hpp"
+#include "CGISpawner.hpp"
+#include "CGIQueue.hpp"
+#include "CGICache.hpp"
 
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -25,11 +32,35 @@ class Server
 {
 private:
     const ServerConfig& _config;
+    FileCache _fileCache;
+    OpenFileCache _openFiles;
+    // One pool per fastcgi_pass address, created on first use
+    std::map<std::string, FastCGIPool*> _fastcgiPools;
+    // Forks the CGI scripts when the worker runs spawn helpers, may be NULL
+    CGISpawner* _spawner;
+    // One queue per location with cgi_max_concurrency, created on first use
+    std::map<const Location*, CGIQueue*> _cgiQueues;
+    // One cache per location with cgi_cache on, created on first use
+    std::map<const Location*, CGICache*> _cgiCaches;
 
-    void receiveRequest(int client_fd, HTTPRequest& request);
+    void receiveRequest(int client_fd, ClientConnection& connection);
+    void feedRequest(ClientConnection& connection, const char* data, size_t len);
+    void rejectInvalidRequest(ClientConnection& connection);
     void handleGetOrPostRequest(int client_fd, ClientConnection& connection);
+    std::string resolvePath(const HTTPRequest& request, const Location* location) const;
     void handleDeleteRequest(ClientConnection& connection);
     void serveStaticFile(int client_fd, const std::string& filePath, HTTPResponse& response, const HTTPRequest& request);
+    bool openStaticFile(const std::string& path, unsigned long now, const CachedFile*& cached, OpenFile*& file);
+    bool serveSidecar(const std::string& path, time_t mtime, const HTTPRequest& request,
+                      HTTPResponse& response, unsigned long now);
+    void serveCachedFile(const CachedFile& file, const std::string& filePath, const HTTPRequest& request, HTTPResponse& response);
+    void serveOpenFile(OpenFile* file, const std::string& filePath, const HTTPRequest& request, HTTPResponse& response);
+    bool isNotModified(const HTTPRequest& request, const std::string& etag, time_t mtime) const;
+    void setNotModified(HTTPResponse& response, const std::string& etag, const std::string& lastModified);
+    HTTPRequest::RangeStatus resolveRanges(const HTTPRequest& request, off_t size, const std::string& etag,
+                                           time_t mtime, std::vector<ByteRange>& ranges) const;
+    void setRangeNotSatisfiable(HTTPResponse& response, off_t size);
+    std::string getContentType(const std::string& filePath) const;
     void handleFileUpload(const HTTPRequest& request, HTTPResponse& response, const std::string& boundary);
 	bool isPathAllowed(const std::string& path, const std::string& uploadPath);
 	std::string sanitizeFilename(const std::string& filename);
@@ -38,15 +69,28 @@ private:
     bool hasCgiExtension(const std::string& extension) const;
     bool endsWith(const std::string& str, const std::string& suffix) const;
 	std::string getInterpreterForExtension(const std::string& extension, const Location* location) const;
+    FastCGIPool& getFastCGIPool(const std::string& address);
+    CGIQueue* getCgiQueue(const Location* location);
+    CGICache* getCgiCache(const Location* location);
+    bool lookupCgiCache(int client_fd, ClientConnection& connection, const Location* location, std::string& cacheKey);
 public:
-    Server(const ServerConfig& config);
+    Server(const ServerConfig& config, CGISpawner* spawner = NULL);
     ~Server();
 
     void handleHttpRequest(int client_fd, ClientConnection& connection);
+    // POST to a CGI with an announced length: handled once the headers are
+    // parsed, the body is piped to the script as it arrives
+    bool streamsRequestBody(const HTTPRequest& request) const;
+    // gzip / deflate the response if the location and the client allow it
+    void encodeResponse(ClientConnection& connection);
+    // Clients waiting for a CGI slot that has been freed, or for a script
+    // that ended without a response to share
+    void collectCgiReady(std::set<int>& pending);
 
     int acceptNewClient(int server_fd);
 
     void handleClient(int client_fd, ClientConnection& connection);
+    void handlePipelinedRequest(ClientConnection& connection);
     void handleResponseSending(int client_fd, ClientConnection& connection);
     const ServerConfig& getConfig() const;
 	std::string getFileExtension(const std::string& path) const;
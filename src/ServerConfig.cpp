@@ -5,7 +5,9 @@
 #include <iostream>
 #include <cstring>
 
-ServerConfig::ServerConfig() : index("index.html"), host("0.0.0.0"), clientMaxBodySize(0), autoindex(false) {
+ServerConfig::ServerConfig() : index("index.html"), host("0.0.0.0"), clientMaxBodySize(0), autoindex(false),
+	fileCacheSize(8 * 1024 * 1024), fileCacheMaxFile(256 * 1024), fileCacheValidMs(1000), openFileCacheMax(64),
+	fastcgiKeepalive(8) {
 	serverNames.push_back("localhost");
 }
 
@@ -19,6 +21,11 @@ ServerConfig::ServerConfig(const ServerConfig& other) {
 	host = other.host;
 	cgiExtensions = other.cgiExtensions;
 	clientMaxBodySize = other.clientMaxBodySize;
+	fileCacheSize = other.fileCacheSize;
+	fileCacheMaxFile = other.fileCacheMaxFile;
+	fileCacheValidMs = other.fileCacheValidMs;
+	openFileCacheMax = other.openFileCacheMax;
+	fastcgiKeepalive = other.fastcgiKeepalive;
 	cgiInterpreters = other.cgiInterpreters;
 }
 
@@ -53,6 +60,11 @@ ServerConfig& ServerConfig::operator=(const ServerConfig& other) {
 		cgiExtensions = other.cgiExtensions;
 		clientMaxBodySize = other.clientMaxBodySize;
 		autoindex = other.autoindex;
+		fileCacheSize = other.fileCacheSize;
+		fileCacheMaxFile = other.fileCacheMaxFile;
+		fileCacheValidMs = other.fileCacheValidMs;
+		openFileCacheMax = other.openFileCacheMax;
+		fastcgiKeepalive = other.fastcgiKeepalive;
 		cgiInterpreters = other.cgiInterpreters;
 	}
 	return *this;
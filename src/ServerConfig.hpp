@@ -19,6 +19,15 @@ public:
     std::string host;
     int clientMaxBodySize;
     bool autoindex;
+    // In-memory static file cache: byte budget (0 disables it), largest
+    // cached file and how long an entry is trusted before a stat() check
+    size_t fileCacheSize;
+    size_t fileCacheMaxFile;
+    unsigned long fileCacheValidMs;
+    // Open descriptors kept for files too large for the content cache (0 disables it)
+    size_t openFileCacheMax;
+    // Idle connections kept per FastCGI application (0: one connection per request)
+    size_t fastcgiKeepalive;
 
     // Ajout d'un vecteur pour les extensions CGI
     std::vector<std::string> cgiExtensions;
@@ -40,6 +40,7 @@ void Socket::socket_creation() {
 		Logger::instance().log(ERROR, std::string("Socket creation failed: ") + strerror(errno));
 		return;
 	}
+	set_close_on_exec(_socket_fd);
 
 	int flags = fcntl(_socket_fd, F_GETFL, 0);
 	if (flags == -1) {
@@ -58,7 +59,7 @@ void Socket::socket_creation() {
 }
 
 
-void Socket::socket_binding() {
+void Socket::socket_binding(bool reuse_port) {
 	int add_size = sizeof(address);
 
 	// Set socket options to allow reuse of the address and port
@@ -70,6 +71,17 @@ void Socket::socket_binding() {
 		return;
 	}
 
+#ifdef SO_REUSEPORT
+	if (reuse_port && setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+		Logger::instance().log(ERROR, std::string("Failed to set SO_REUSEPORT: ") + strerror(errno));
+		close(_socket_fd);
+		_socket_fd = -1;
+		return;
+	}
+#else
+	(void)reuse_port;
+#endif
+
 	if (bind(_socket_fd, (struct sockaddr *)&address, add_size) == -1) {
 		Logger::instance().log(ERROR, std::string("Failed to bind socket to IP address and port: " ) + strerror(errno));
 		close(_socket_fd);
@@ -104,8 +116,8 @@ sockaddr_in& Socket::getAddress() {
 	return address;
 }
 
-void Socket::build_sockets() {
-	socket_binding();
+void Socket::build_sockets(bool reuse_port) {
+	socket_binding(reuse_port);
 	if (_socket_fd != -1) {
 		socket_listening();
 	}
@@ -23,7 +23,7 @@ public:
     ~Socket();
 
     void    socket_creation();
-    void    socket_binding();
+    void    socket_binding(bool reuse_port);
     void    socket_listening();
 
     bool    operator==(int fd) const;
@@ -31,6 +31,7 @@ public:
     int     getPort() const;
     sockaddr_in& getAddress() ;
 
-    void    build_sockets();
+    // reuse_port lets several worker processes bind their own listener on the same port
+    void    build_sockets(bool reuse_port = false);
     void    close_sockets();
 };
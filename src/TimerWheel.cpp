@@ -0,0 +1,161 @@
+// TimerWheel.cpp
+#include "TimerWheel.hpp"
+
+Timer::Timer() : expires(0), kind(TIMER_KEEPALIVE), fd(-1), _prev(NULL), _next(NULL), _wheel(NULL) {}
+
+Timer::Timer(const Timer& other)
+    : expires(other.expires), kind(other.kind), fd(other.fd), _prev(NULL), _next(NULL), _wheel(NULL) {}
+
+Timer& Timer::operator=(const Timer& other) {
+    if (this != &other) {
+        if (_wheel)
+            _wheel->cancel(*this);
+        expires = other.expires;
+        kind = other.kind;
+        fd = other.fd;
+    }
+    return *this;
+}
+
+Timer::~Timer() {
+    if (_wheel)
+        _wheel->cancel(*this);
+}
+
+bool Timer::isArmed() const { return _wheel != NULL; }
+
+TimerWheel::TimerWheel(unsigned long now_ms) : _currentTick(now_ms / TICK_MS), _count(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            _slots[level][slot]._prev = &_slots[level][slot];
+            _slots[level][slot]._next = &_slots[level][slot];
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            Timer& head = _slots[level][slot];
+            while (!isEmpty(head)) {
+                Timer* timer = head._next;
+                unlink(*timer);
+                timer->_wheel = NULL;
+            }
+        }
+    }
+}
+
+bool TimerWheel::isEmpty(const Timer& head) {
+    return head._next == &head;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer._prev->_next = timer._next;
+    timer._next->_prev = timer._prev;
+    timer._prev = NULL;
+    timer._next = NULL;
+}
+
+void TimerWheel::insert(Timer& timer) {
+    // Never fire early: round the deadline up to the next tick
+    unsigned long tick = (timer.expires + TICK_MS - 1) / TICK_MS;
+    if (tick < _currentTick)
+        tick = _currentTick;
+    unsigned long delta = tick - _currentTick;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1UL << (SLOT_BITS * (level + 1))))
+        ++level;
+    unsigned long maxDelta = (1UL << (SLOT_BITS * LEVELS)) - 1;
+    if (delta > maxDelta)
+        tick = _currentTick + maxDelta;
+
+    Timer& head = _slots[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    timer._next = &head;
+    timer._prev = head._prev;
+    head._prev->_next = &timer;
+    head._prev = &timer;
+}
+
+void TimerWheel::arm(Timer& timer, unsigned long deadline_ms) {
+    if (timer._wheel)
+        cancel(timer);
+    timer.expires = deadline_ms;
+    timer._wheel = this;
+    insert(timer);
+    ++_count;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer._wheel != this)
+        return;
+    unlink(timer);
+    timer._wheel = NULL;
+    --_count;
+}
+
+void TimerWheel::cascade(int level) {
+    Timer& head = _slots[level][(_currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    // Detach the whole bucket first: re-inserted timers may land in it again
+    Timer pending;
+    pending._prev = &pending;
+    pending._next = &pending;
+    if (!isEmpty(head)) {
+        pending._next = head._next;
+        pending._prev = head._prev;
+        head._next->_prev = &pending;
+        head._prev->_next = &pending;
+        head._next = &head;
+        head._prev = &head;
+    }
+    while (!isEmpty(pending)) {
+        Timer* timer = pending._next;
+        unlink(*timer);
+        insert(*timer);
+    }
+}
+
+void TimerWheel::advance(unsigned long now_ms, std::vector<Timer*>& expired) {
+    unsigned long target = now_ms / TICK_MS;
+    if (_count == 0) {
+        // Nothing to cascade, no need to walk the idle ticks one by one
+        if (target >= _currentTick)
+            _currentTick = target + 1;
+        return;
+    }
+    while (_currentTick <= target) {
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((_currentTick & ((1UL << (SLOT_BITS * level)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+        Timer& head = _slots[0][_currentTick & (SLOTS - 1)];
+        while (!isEmpty(head)) {
+            Timer* timer = head._next;
+            unlink(*timer);
+            timer->_wheel = NULL;
+            --_count;
+            expired.push_back(timer);
+        }
+        ++_currentTick;
+    }
+}
+
+int TimerWheel::nextTimeout(unsigned long now_ms) const {
+    if (_count == 0)
+        return -1;
+    unsigned long nowTick = now_ms / TICK_MS;
+    for (int i = 0; i < SLOTS; ++i) {
+        unsigned long tick = _currentTick + i;
+        // Higher levels are cascaded when level 0 wraps: wake up then at the latest
+        if ((tick & (SLOTS - 1)) == 0 || !isEmpty(_slots[0][tick & (SLOTS - 1)])) {
+            if (tick <= nowTick)
+                return 0;
+            return static_cast<int>((tick * TICK_MS) - now_ms);
+        }
+    }
+    return 0;
+}
+
+size_t TimerWheel::size() const { return _count; }
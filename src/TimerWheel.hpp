@@ -0,0 +1,69 @@
+// TimerWheel.hpp
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+#include <cstddef>
+
+class TimerWheel;
+
+enum TimerKind { TIMER_HEADER_READ, TIMER_BODY_READ, TIMER_KEEPALIVE, TIMER_SEND, TIMER_CGI };
+
+// Intrusive timer node, embedded in its owner. Copies are never armed.
+struct Timer {
+    unsigned long expires;
+    TimerKind kind;
+    int fd;
+
+    Timer();
+    Timer(const Timer& other);
+    Timer& operator=(const Timer& other);
+    ~Timer();
+
+    bool isArmed() const;
+
+private:
+    friend class TimerWheel;
+    Timer* _prev;
+    Timer* _next;
+    TimerWheel* _wheel;
+};
+
+// Hierarchical timing wheel: 4 levels of 64 slots with a 10 ms tick,
+// O(1) arm/cancel and cascading of far deadlines towards level 0.
+class TimerWheel {
+public:
+    TimerWheel(unsigned long now_ms);
+    ~TimerWheel();
+
+    void arm(Timer& timer, unsigned long deadline_ms);
+    void cancel(Timer& timer);
+
+    // Collects every timer whose deadline is <= now
+    void advance(unsigned long now_ms, std::vector<Timer*>& expired);
+    // Milliseconds until the earliest non empty bucket, -1 when idle
+    int nextTimeout(unsigned long now_ms) const;
+    size_t size() const;
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const unsigned long TICK_MS = 10;
+
+    // Circular lists with sentinel heads
+    Timer _slots[LEVELS][SLOTS];
+    // Next tick to be processed
+    unsigned long _currentTick;
+    size_t _count;
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    void insert(Timer& timer);
+    void cascade(int level);
+    static void unlink(Timer& timer);
+    static bool isEmpty(const Timer& head);
+};
+
+#endif
@@ -6,9 +6,13 @@
 
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 
 
+// Inactivity deadlines, armed on the connection timer by the event loop
 #define TIMEOUT_MS 5000
+#define KEEPALIVE_TIMEOUT_MS 15000
+#define SEND_TIMEOUT_MS 30000
 
 template <typename T>
 std::string to_string(T value) {
@@ -22,10 +26,15 @@ namespace serverSignal {
     void signal_handler(int signum);
 }
 
-enum FDType { FD_SERVER_SOCKET, FD_CLIENT_SOCKET, FD_CGI_INPUT, FD_CGI_OUTPUT, FD_UNKNOWN };
+enum FDType { FD_SERVER_SOCKET, FD_CLIENT_SOCKET, FD_CGI_INPUT, FD_CGI_OUTPUT, FD_FASTCGI, FD_SIGNAL_PIPE, FD_SPAWN_STATUS, FD_UNKNOWN };
 
 enum LoggerLevel { DEBUG, INFO, WARNING, ERROR };
 
 unsigned long curr_time_ms();
+// IMF-fixdate, as used by Date, Last-Modified and If-Modified-Since
+std::string http_date(time_t t);
+bool parse_http_date(const std::string& str, time_t& t);
+// Keeps the descriptor out of the CGI scripts
+void set_close_on_exec(int fd);
 
 #endif
@@ -8,69 +8,17 @@
 #include "Logger.hpp"
 #include "ServerConfig.hpp"
 #include "SessionManager.hpp"
-#include <poll.h>
 #include <unistd.h>
 #include <ctime>
 #include <signal.h>
+#include <cstring>
+#include <cerrno>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <map>
-#include "ClientConnection.hpp"
-
-FDType getFDType(int fd, const std::map<int, Server*>& fdToServerMap, const std::map<int, ClientConnection>& connections) {
-    if (fdToServerMap.find(fd) != fdToServerMap.end()) {
-        return FD_SERVER_SOCKET;
-    }
-    if (connections.find(fd) != connections.end()) {
-        return FD_CLIENT_SOCKET;
-    }
-    for (std::map<int, ClientConnection>::const_iterator it = connections.begin(); it != connections.end(); ++it) {
-        CGIHandler* cgiHandler = it->second.getCgiHandler();
-        if (cgiHandler) {
-            if (cgiHandler->getInputPipeFd() == fd) {
-                return FD_CGI_INPUT;
-            }
-            if (cgiHandler->getOutputPipeFd() == fd) {
-                return FD_CGI_OUTPUT;
-            }
-        }
-    }
-    return FD_UNKNOWN;
-}
-
-// Définition du functoOor
-struct MatchFD {
-    int fd;
-    MatchFD(int f) : fd(f) {}
-    bool operator()(const pollfd& pfd) const {
-        return pfd.fd == fd;
-    }
-};
-
-struct MatchCGIOutputFD {
-    int fd;
-    MatchCGIOutputFD(int f) : fd(f) {}
-    bool operator()(const std::pair<const int, ClientConnection>& pair) const {
-            CGIHandler* handler = pair.second.getCgiHandler();
-            if (!handler) {
-                return false;
-            }
-            int handler_fd = handler->getOutputPipeFd();
-            return handler_fd == fd;
-        }
-
-};
-
-struct MatchCGIInputFD {
-    int fd;
-    MatchCGIInputFD(int f) : fd(f) {}
-    bool operator()(const std::pair<const int, ClientConnection>& pair) const {
-            CGIHandler* handler = pair.second.getCgiHandler();
-            if (!handler) {
-                return false;
-            }
-            int handler_fd = handler->getInputPipeFd();
-            return handler_fd == fd;
-        }
-};
+#include "EventLoop.hpp"
+#include "Poller.hpp"
+#include "CGISpawner.hpp"
 
 void initialize_random_generator() {
     std::ifstream urandom("/dev/urandom", std::ios::binary);
@@ -100,216 +48,169 @@ void	throttle_calls(void)
 	last_call = curr_time_ms();
 }
 
-void manageConnections(std::map<int, ClientConnection>& connections, std::vector<pollfd>& poll_fds) {
-    std::map<int, ClientConnection>::iterator it_conn;
-    for (it_conn = connections.begin(); it_conn != connections.end();) {
-        int client_fd = it_conn->first;
-        HTTPRequest* request = it_conn->second.getRequest();
-        ClientConnection& connection = it_conn->second;
+void setupSignals() {
+    if (pipe(serverSignal::pipe_fd) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    set_close_on_exec(serverSignal::pipe_fd[0]);
+    set_close_on_exec(serverSignal::pipe_fd[1]);
 
-        if (connection.getRequest() && connection.getRequest()->getConnectionClosed())
-        {
-            connection.resetConnection();
-            std::map<int, ClientConnection>::iterator it_to_erase = it_conn++;
-            connections.erase(it_to_erase);
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds.erase(poll_fds.begin() + i);
-                    break;
-                }
-            }
-            continue;
-        }
+    // Configuration du signal handler
+    struct sigaction sa;
+    sa.sa_handler = serverSignal::signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // Exited children (CGI scripts or workers) are reaped from the event loop;
+    // frequent under CGI load, so interrupted system calls are restarted
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+    // Writing to a closed socket or CGI pipe must fail with EPIPE, not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // The handler must never block, even if the loop is late draining the pipe
+    int flags = fcntl(serverSignal::pipe_fd[1], F_GETFL, 0);
+    if (flags != -1)
+        fcntl(serverSignal::pipe_fd[1], F_SETFL, flags | O_NONBLOCK);
+}
 
-        if (connection.getExchangeOver()) {
-            connection.resetConnection();
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds[i].events &= ~POLLOUT;
-                    poll_fds[i].events |= POLLIN;
-                    break;
-                }
-            }
-            ++it_conn;
-            continue;
-        }
+int runWorker(const ConfigParser& configParser, bool reusePort) {
+    const std::vector<ServerConfig>& serverConfigs = configParser.getServerConfigs();
+    std::vector<Server*> servers;
+    std::vector<Socket*> sockets;
 
-        if (connection.getCgiHandler() && !connection.getCgiHandler()->hasReceivedBody()) {
-            if (connection.getCgiHandler()->hasTimedOut()) {
-                connection.getCgiHandler()->terminateCGI();
-                HTTPResponse* cgiResponse = new HTTPResponse();
-                cgiResponse->beError(504, "CGI script timed out");
-                cgiResponse->setHeader("Connection", "close");
+    // Forked first, while the worker holds no cache, socket or poller
+    CGISpawner spawner;
+    bool spawnHelpers = spawner.start(configParser.getGlobalConfig().cgiSpawnHelpers);
 
-                delete connection.getCgiHandler();
-                connection.setCgiHandler(NULL);
-                if (connection.getResponse())
-                    delete connection.getResponse();
-                connection.setResponse(cgiResponse);
-                connection.prepareResponse();
-                ++it_conn;
-                continue;
-            }
-            //In case of CGI, sleeps 5ms to give a little time for the process to close, Otherwise waitpid ca return 0 indefinitely;
-            usleep(5000);
-            int cgiStatus = connection.getCgiHandler()->isCgiDone();
-            if (cgiStatus) {
-                HTTPResponse* cgiResponse = new HTTPResponse();
-                cgiResponse->beError(500, std::string("CGI process was stopped unintentionnally Exit code : ") + to_string(cgiStatus));
-                connection.getCgiHandler()->terminateCGI();
-                for (size_t i = 0; i < poll_fds.size(); ++i) {
-                    if (poll_fds[i].fd == connection.getCgiHandler()->getOutputPipeFd()) {
-                        poll_fds.erase(poll_fds.begin() + i);
-                        break;
-                    }
-                }
-                delete connection.getCgiHandler();
-                connection.setCgiHandler(NULL);
-                if (connection.getResponse())
-                    delete connection.getResponse();
-                connection.setResponse(cgiResponse);
-                connection.prepareResponse();
-                ++it_conn;
-                continue;
-            }
-            ++it_conn;
-            continue;
-        }
+    EventLoop loop(Poller::create(configParser.getGlobalConfig().eventBackend));
 
-        if (connection.getResponse() != NULL) {
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds[i].events |= POLLOUT;
-                    break;
-                }
-            }
-            ++it_conn;
-            continue;
-        }
+    // Ajouter le descripteur du pipe pour pouvoir détecter le signal d'arrêt
+    loop.addSignalPipe(serverSignal::pipe_fd[0]);
+    if (spawnHelpers)
+        loop.addSpawner(&spawner);
 
-        if (connection.getRequest() && connection.getRequest()->getErrorCode() != 0) {
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds.erase(poll_fds.begin() + i);
-                    break;
-                }
-                connection.resetConnection();
+    // Créer les serveurs et les sockets
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+    Server* server = new Server(serverConfigs[i], spawnHelpers ? &spawner : NULL);
+    servers.push_back(server);
 
-            }
-            connections.erase(client_fd);
-            ++it_conn;
-            continue;
-        }
+        for (size_t j = 0; j < serverConfigs[i].ports.size(); ++j) {
+            int port = serverConfigs[i].ports[j];
+            Socket* socket = new Socket(serverConfigs[i].getHost(), port);
+            socket->build_sockets(reusePort);
 
+            // Associer les sockets serveurs avec les serveurs
+            loop.addListener(socket->getSocket(), server);
 
-        if (request && request->isComplete() && request->getErrorCode() == 0 && !connection.getCgiHandler()) {
-            Logger::instance().log(INFO, "Parsing OK, handling request for client fd: " + to_string(client_fd));
-            connection.getServer()->handleHttpRequest(client_fd, connection);
-            if (connection.getResponse() != NULL) {
+            sockets.push_back(socket);
 
-                connection.prepareResponse();
+            Logger::instance().log(INFO, "Server launched, listening on " + serverConfigs[i].getHost() + ":" + to_string(port));
+        }
+    }
 
-                // Ensure POLLOUT is enabled
-                for (size_t i = 0; i < poll_fds.size(); ++i) {
-                    if (poll_fds[i].fd == client_fd) {
-                        poll_fds[i].events |= POLLOUT;
-                        break;
-                    }
-                }
-            } else if (connection.getCgiHandler()) {
-                int cgi_input_fd = connection.getCgiHandler()->getInputPipeFd();
-                if (cgi_input_fd != -1) {
-                    pollfd cgiInput;
-                    cgiInput.fd = cgi_input_fd;
-                    cgiInput.events = POLLOUT;
-                    cgiInput.revents = 0;
-                    poll_fds.push_back(cgiInput);
+    loop.run();
+    // Running scripts hold slots of queues owned by the servers
+    loop.closeConnections();
 
-                    for (size_t i = 0; i < poll_fds.size(); ++i) {
-                        if (poll_fds[i].fd == client_fd) {
-                            poll_fds[i].events = 0;
-                        }
-                    }
-                }
-            } else {
-                Logger::instance().log(ERROR, "No response or CGI handler after handleHttpRequest");
-            }
-            ++it_conn;
-            continue;
-        }
-        //Logger::instance().log(DEBUG, std::string("A connection didn't match any condition in manageConnections :") + to_string(client_fd));
-        ++it_conn;
+    // Nettoyer la mémoire
+    for (size_t i = 0; i < servers.size(); ++i) {
+        delete servers[i];
     }
+    for (size_t i = 0; i < sockets.size(); ++i)
+        delete sockets[i];
+    return 0;
 }
 
+pid_t spawnWorker(const ConfigParser& configParser) {
+    // A stop signal caught before the worker has its own pipe would be lost
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &previous);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        Logger::instance().log(ERROR, std::string("Failed to fork worker: ") + strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        // The worker gets its own signal pipe and its own session id sequence
+        close(serverSignal::pipe_fd[0]);
+        close(serverSignal::pipe_fd[1]);
+        setupSignals();
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        initialize_random_generator();
+        int status = runWorker(configParser, true);
+        // Skip static destructors: the Logger prompt belongs to the master
+        _exit(status);
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+    Logger::instance().log(INFO, "Worker " + to_string(pid) + " started");
+    return pid;
+}
 
-int manageTimeouts(std::map<int, ClientConnection>& connections, std::vector<pollfd>& poll_fds) {
-    unsigned long now = curr_time_ms();
-    unsigned long min_remaining_time = TIMEOUT_MS;
-    bool has_active_connections = false;
+int runMaster(const ConfigParser& configParser, int workers) {
+    std::map<pid_t, unsigned long> children;
+    for (int i = 0; i < workers; ++i) {
+        pid_t pid = spawnWorker(configParser);
+        if (pid > 0)
+            children[pid] = curr_time_ms();
+    }
+    Logger::instance().log(INFO, "Master " + to_string(getpid()) + " supervising " + to_string(children.size()) + " workers");
 
-    std::map<int, ClientConnection>::iterator it_conn;
-    for (it_conn = connections.begin(); it_conn != connections.end(); ) {
-        int client_fd = it_conn->first;
-        HTTPRequest* request = it_conn->second.getRequest();
-        ClientConnection& connection = it_conn->second;
-        if (connection.getCgiHandler())
-            has_active_connections = true;
-        if ((!request && !connection.getUsed())|| connection.getExchangeOver() == true || connection.getCgiHandler()) {
-            ++it_conn;
-            continue;
+    bool stopServer = false;
+    while (!stopServer) {
+        char byte;
+        ssize_t bytesRead = read(serverSignal::pipe_fd[0], &byte, sizeof(byte));
+        if (bytesRead <= 0) {
+            if (bytesRead == -1 && errno == EINTR)
+                continue;
+            break;
+        }
+        if (byte != SIGCHLD) {
+            Logger::instance().log(INFO, "Signal received, stopping the workers...");
+            stopServer = true;
+            break;
         }
 
-        unsigned long time_since_last_activity = 0;
-        if (request)
-            time_since_last_activity = now - request->getLastActivity();
-
-        if (request && !request->isComplete() && time_since_last_activity >= TIMEOUT_MS) {
-            Logger::instance().log(INFO, "Connection timed out for client FD: " + to_string(client_fd));
-
-            HTTPResponse* timeoutResponse = new HTTPResponse();
-            timeoutResponse->beError(408); // Request Timeout
-            if (connection.getResponse())
-                    delete connection.getResponse();
-            connection.setResponse(timeoutResponse);
-            connection.prepareResponse();
-
-            for (size_t i = 0; i < poll_fds.size(); ++i) {
-                if (poll_fds[i].fd == client_fd) {
-                    poll_fds[i].events |= POLLOUT;
-                    break;
-                }
-            }
-            request->setLastActivity(now);
-            ++it_conn;
-            continue;
-        } else if (request && !request->isComplete()) {
-            // Mettre à jour le temps restant et continuer
-            unsigned long remaining_time = TIMEOUT_MS - time_since_last_activity;
-            if (remaining_time < min_remaining_time) {
-                min_remaining_time = remaining_time;
-            }
-            has_active_connections = true;
-            ++it_conn;
-        } else {
-            ++it_conn;
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            std::map<pid_t, unsigned long>::iterator it = children.find(pid);
+            if (it == children.end())
+                continue;
+            unsigned long lifetime = curr_time_ms() - it->second;
+            children.erase(it);
+            Logger::instance().log(WARNING, "Worker " + to_string(pid) + " died unexpectedly, respawning");
+            // Do not fork in a tight loop when workers cannot even start
+            if (lifetime < 1000)
+                sleep(1);
+            pid_t newPid = spawnWorker(configParser);
+            if (newPid > 0)
+                children[newPid] = curr_time_ms();
         }
     }
 
-    int poll_timeout;
-    if (has_active_connections) {
-        poll_timeout = static_cast<int>(min_remaining_time);
-    } else {
-        //Logger::instance().log(DEBUG, "No active connection, poll waiting indefinitely");
-        poll_timeout = -1; // Bloquer indéfiniment si aucune connexion active
+    for (std::map<pid_t, unsigned long>::iterator it = children.begin(); it != children.end(); ++it)
+        kill(it->first, SIGTERM);
+    for (std::map<pid_t, unsigned long>::iterator it = children.begin(); it != children.end(); ++it) {
+        while (waitpid(it->first, NULL, 0) == -1 && errno == EINTR)
+            ;
     }
-    return poll_timeout;
+    return 0;
 }
 
-
 int main(int argc, char* argv[]) {
     Logger::instance().log(INFO, "Starting main");
-    bool stopServer = false;
+    // The log files, and whatever the shell left open, are not the scripts' business
+    long maxFd = sysconf(_SC_OPEN_MAX);
+    for (int fd = STDERR_FILENO + 1; fd < (maxFd > 0 && maxFd < 4096 ? maxFd : 4096); ++fd)
+        set_close_on_exec(fd);
 
     std::string configFile;
     if (argc > 3) {
@@ -347,319 +248,14 @@ int main(int argc, char* argv[]) {
     const std::vector<ServerConfig>& serverConfigs = configParser.getServerConfigs();
     Logger::instance().log(INFO, to_string(serverConfigs.size()) + " servers successfully configured");
 
-    if (pipe(serverSignal::pipe_fd) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
+    int workers = configParser.getGlobalConfig().workerProcesses;
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? static_cast<int>(cpus) : 1;
     }
 
-    // Configuration du signal handler
-    struct sigaction sa;
-    sa.sa_handler = serverSignal::signal_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-
-    std::map<int, ClientConnection> connections;
-
-    std::vector<Server*> servers;
-    std::vector<Socket*> sockets;
-    std::vector<pollfd> poll_fds;
-    std::map<int, Server*> fdToServerMap;
-
-    // Ajouter le descripteur du pipe à poll_fds pour pouvoir détecter le signal d'arrêt
-    {
-        pollfd pfd;
-        pfd.fd = serverSignal::pipe_fd[0];
-        pfd.events = POLLIN;
-        pfd.revents = 0; // Initialize revents to 0
-        poll_fds.push_back(pfd);
-    }
-
-    // Créer les serveurs et les sockets
-    for (size_t i = 0; i < serverConfigs.size(); ++i) {
-    Server* server = new Server(serverConfigs[i]);
-    servers.push_back(server);
-
-        for (size_t j = 0; j < serverConfigs[i].ports.size(); ++j) {
-            int port = serverConfigs[i].ports[j];
-            Socket* socket = new Socket(serverConfigs[i].getHost(), port);
-            socket->build_sockets();
-
-            pollfd pfd;
-            pfd.fd = socket->getSocket();
-            pfd.events = POLLIN;
-            pfd.revents = 0; // Initialize revents to 0
-            poll_fds.push_back(pfd);
-
-            // Associer les sockets serveurs avec les serveurs
-            fdToServerMap[socket->getSocket()] = server;
-
-            sockets.push_back(socket);
-
-            Logger::instance().log(INFO, "Server launched, listening on " + serverConfigs[i].getHost() + ":" + to_string(port));
-        }
-    }
-
-    while (!stopServer) {
-
-        manageConnections(connections, poll_fds);
-        int poll_timeout = manageTimeouts(connections, poll_fds);
-
-        int poll_count = poll(&poll_fds[0], poll_fds.size(), poll_timeout);
-
-        if (poll_count < 0) {
-            if (errno == EINTR) {
-                // poll() a été interrompu par un signal, continuer la boucle
-                continue;
-            } else {
-                perror("Error calling poll");
-                break; // Ou gérer l'erreur de manière appropriée
-            }
-        }
-
-        for (size_t i = 0; i < poll_fds.size(); ++i) {
-            if (poll_fds[i].revents == 0)
-                continue;
-
-            //Logger::instance().log(DEBUG, std::string("Event : ") + to_string(poll_fds[i].revents) + " detected on client_fd : " + to_string(poll_fds[i].fd));
-
-            if (poll_fds[i].fd == serverSignal::pipe_fd[0]) {
-                if (poll_fds[i].revents & POLLIN) {
-                    // Lire le(s) octet(s) du pipe pour vider le buffer
-                    uint8_t byte;
-                    ssize_t bytesRead = read(serverSignal::pipe_fd[0], &byte, sizeof(byte));
-                    if (bytesRead > 0) {
-                        Logger::instance().log(INFO, "Signal received, stopping the server...");
-                        stopServer = true;
-                        break;
-                    }
-                }
-                continue;
-            }
-
-            FDType fdType = getFDType(poll_fds[i].fd, fdToServerMap, connections);
-
-            if (fdType == FD_UNKNOWN)
-                Logger::instance().log(DEBUG, std::string("Unknown FD type sent by poll, fd = ") + to_string(poll_fds[i].fd));
-
-            // Gérer les erreurs
-            if (poll_fds[i].revents & POLLERR) {
-                Logger::instance().log(ERROR, "Error on file descriptor: " + to_string(poll_fds[i].fd));
-                if (fdToServerMap.find(poll_fds[i].fd) != fdToServerMap.end()) {
-                    // C'est un socket serveur
-                    Logger::instance().log(ERROR, "Error on server socket detected in poll");
-                } else {
-                    // C'est un socket client
-                    Logger::instance().log(ERROR, "Error on client socket detected in poll");
-                    close(poll_fds[i].fd);
-                    connections.erase(poll_fds[i].fd);
-                    poll_fds.erase(poll_fds.begin() + i);
-                    --i;
-                }
-                continue;
-            }
-
-            // Gérer les déconnexions
-            if (poll_fds[i].revents & POLLHUP) {
-                if (fdType == FD_CLIENT_SOCKET) {
-                    Logger::instance().log(INFO, "Disconnected client FD: " + to_string(poll_fds[i].fd));
-                    close(poll_fds[i].fd);
-                    connections.erase(poll_fds[i].fd);
-                    poll_fds.erase(poll_fds.begin() + i);
-                    --i;
-                } else if (fdType == FD_CGI_OUTPUT) {
-
-                    // Trouver la connexion associée
-                    std::map<int, ClientConnection>::iterator it = std::find_if(
-                        connections.begin(),
-                        connections.end(),
-                        MatchCGIOutputFD(poll_fds[i].fd)
-                    );
-                    if (it != connections.end()) {
-                        ClientConnection& connection = it->second;
-                        connection.getCgiHandler()->readFromCGI();
-                        // Fermer le descripteur de sortie du pipe
-                        connection.getCgiHandler()->closeOutputPipe();
-                        poll_fds.erase(poll_fds.begin() + i);
-                        --i;
-
-                        std::string cgiOutput = connection.getCgiHandler()->getCGIOutput();
-                        HTTPResponse* cgiResponse = new HTTPResponse();
-                        cgiResponse->parseCGIOutput(cgiOutput);
-
-						cgiResponse->setHeader("Connection", "keep-alive");
-
-                        if (connection.getResponse())
-                            delete connection.getResponse();
-
-                        connection.setResponse(cgiResponse);
-                        connection.prepareResponse();
-
-                        delete connection.getCgiHandler();
-                        connection.setCgiHandler(NULL);
-
-                        for (size_t j = 0; j < poll_fds.size(); ++j) {
-                            if (poll_fds[j].fd == it->first) {
-                                poll_fds[j].events |= POLLOUT;
-                                break;
-                            }
-                        }
-                    }
-                }
-                continue;
-            }
-
-            if (poll_fds[i].revents & POLLNVAL) {
-            // if (fdType == FD_CGI_OUTPUT) {
-                //     std::map<int, ClientConnection>::iterator it = std::find_if(
-                //         connections.begin(),
-                //         connections.end(),
-                //         MatchCGIOutputFD(poll_fds[i].fd)
-                //     );
-                //     if (it != connections.end()) {
-                //         ClientConnection& connection = it->second;
-                //         connection.getCgiHandler()->terminateCGI();
-                //         connection.setResponse(new HTTPResponse());
-                //         connection.getResponse()->beError(502);
-                //         connection.prepareResponse();
-                //     }
-                // }
-                Logger::instance().log(ERROR, "Filme descriptor not valid: " + to_string(poll_fds[i].fd));
-                poll_fds.erase(poll_fds.begin() + i);
-                --i;
-                continue;
-            }
-
-            // Gérer POLLIN et POLLOUT
-            if (poll_fds[i].revents & POLLIN) {
-                if (fdType == FD_SERVER_SOCKET) {
-				    Logger::instance().log(DEBUG, std::string("POLLIN on server socket, new connection will be created for fd : ") + to_string(poll_fds[i].fd));
-				    Server* server = fdToServerMap[poll_fds[i].fd];
-				    int client_fd = server->acceptNewClient(poll_fds[i].fd);
-
-				    if (client_fd != -1) {
-				        // Enregistrer l'association client_fd -> server
-				        // std::pair<std::map<int, ClientConnection>::iterator, bool> result =
-				            connections.insert(std::make_pair(client_fd, ClientConnection(server)));
-
-				        // Créer un nouvel objet HTTPRequest et le stocker dans la connexion
-				        // int max_body_size = server->getConfig().clientMaxBodySize;
-				        // std::map<int, ClientConnection>::iterator conn_it = result.first;
-                        // if (conn_it->second.getRequest() == NULL) {
-    				    //     conn_it->second.setRequest(new HTTPRequest(max_body_size));
-                        // }
-
-				        pollfd client_pollfd;
-				        client_pollfd.fd = client_fd;
-				        client_pollfd.events = POLLIN | POLLHUP | POLLERR;
-				        client_pollfd.revents = 0;
-				        poll_fds.push_back(client_pollfd);
-				        Logger::instance().log(DEBUG, "New pollfd added for client with FD: " + to_string(client_fd) + " accepted on server FD: " + to_string(poll_fds[i].fd));
-				    } else {
-				        Logger::instance().log(ERROR, "Failure accepting client on server FD: " + to_string(poll_fds[i].fd));
-				    }
-				    continue;
-				} else if (fdType == FD_CLIENT_SOCKET) {
-                    std::map<int, ClientConnection>::iterator conn_it = connections.find(poll_fds[i].fd);
-                    if (conn_it != connections.end()) {
-                        ClientConnection& connection = conn_it->second;
-                        Server* server = connection.getServer();
-                        server->handleClient(poll_fds[i].fd, connection);
-                    }
-                    continue;
-                } else if (fdType == FD_CGI_OUTPUT) {
-                        std::map<int, ClientConnection>::iterator it = std::find_if(
-                        connections.begin(),
-                        connections.end(),
-                        MatchCGIOutputFD(poll_fds[i].fd)
-                    );
-                    ClientConnection& connection = it->second;
-                    CGIHandler* cgiHandler = connection.getCgiHandler();
-                    // normalement pas indispensable pusiaue checke dans manageconnections
-                    // if (cgiHandler->hasTimedOut()) {
-                    //     cgiHandler->terminateCGI();
-                    //     connection.setResponse(new HTTPResponse());
-                    //     connection.getResponse()->beError(504);
-                    //     connection.prepareResponse();
-                    // } else {
-                        int received = cgiHandler->readFromCGI();
-                        if (!received) {
-                            poll_fds.erase(poll_fds.begin() + i);
-                            --i;
-
-                            std::string cgiOutput = cgiHandler->getCGIOutput();
-                            HTTPResponse* cgiResponse = new HTTPResponse();
-                            cgiResponse->parseCGIOutput(cgiOutput);
-							cgiResponse->setHeader("Connection", "keep-alive");
-                            if (connection.getResponse())
-                                delete connection.getResponse();
-                            connection.setResponse(cgiResponse);
-                            connection.prepareResponse();
-
-                            // Activer POLLOUT sur le descripteur du client pour envoyer la réponse
-                            for (size_t j = 0; j < poll_fds.size(); ++j) {
-                                if (poll_fds[j].fd == it->first) {  // it->first est le fd du client associé à cette connexion
-                                    poll_fds[j].events |= POLLOUT;
-                                    break;
-                                }
-                            }
-                            continue;
-                        }
-                    // }
-                } else {
-                    Logger::instance().log(WARNING, std::string("Unhandled POLLIN event on fd : ") + to_string(poll_fds[i].fd));
-                }
-            }
-            if (poll_fds[i].revents & POLLOUT) {
-                // C'est un socket prêt à écrire
-                if (fdType == FD_CLIENT_SOCKET) {
-                    std::map<int, ClientConnection>::iterator conn_it = connections.find(poll_fds[i].fd);
-                    ClientConnection& connection = conn_it->second;
-                    Server* server = connection.getServer();
-                    server->handleResponseSending(poll_fds[i].fd, conn_it->second);
-                } else if (fdType == FD_CGI_INPUT) {
-                    std::map<int, ClientConnection>::iterator it = std::find_if(
-                        connections.begin(),
-                        connections.end(),
-                        MatchCGIInputFD(poll_fds[i].fd)
-                    );
-                    ClientConnection& connection = it->second;
-                    int sending = connection.getCgiHandler()->writeToCGI();
-                    if (!sending) {
-                        poll_fds[i].events &= ~POLLOUT;
-                        close(poll_fds[i].fd);
-                        poll_fds.erase(poll_fds.begin() + i);
-                        --i;
-
-                        int cgi_output_fd = connection.getCgiHandler()->getOutputPipeFd();
-                        if (cgi_output_fd != -1) {
-                            pollfd cgiOutput;
-                            cgiOutput.fd = cgi_output_fd;
-                            cgiOutput.events = POLLIN;
-                            cgiOutput.revents = 0;
-                            poll_fds.push_back(cgiOutput);
-                        }
-                        continue;
-                    }
-                } else {
-                    Logger::instance().log(WARNING, std::string("Unhandled POLLOUT event on fd : ") + to_string(poll_fds[i].fd));
-                }
-            }
-
-        }
-
-        if (stopServer)
-            break;
-    }
-
-    // Nettoyer les objets HTTPRequest restants
-    connections.clear();
-
-    // Nettoyer la mémoire
-    for (size_t i = 0; i < servers.size(); ++i) {
-        delete servers[i];
-    }
-    for (size_t i = 0; i < sockets.size(); ++i)
-        delete sockets[i];
-    return 0;
+    setupSignals();
+    if (workers == 1)
+        return runWorker(configParser, false);
+    return runMaster(configParser, workers);
 }
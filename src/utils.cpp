@@ -1,12 +1,20 @@
 #include "Utils.hpp"
 
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+
 namespace serverSignal {
     int pipe_fd[2];
 
     void signal_handler(int signum) {
-		(void)signum;
-        char byte = 1;
+        // A full pipe makes write() fail: the interrupted code must not see its errno
+        int savedErrno = errno;
+        // The signal number tells the reader which signal was caught
+        char byte = static_cast<char>(signum);
         write(pipe_fd[1], &byte, sizeof(byte));
+        errno = savedErrno;
     }
 }
 
@@ -15,3 +23,27 @@ unsigned long curr_time_ms() {
     gettimeofday(&tv, NULL);
     return static_cast<unsigned long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
 }
+
+std::string http_date(time_t t) {
+    struct tm tm;
+    char buffer[64];
+    gmtime_r(&t, &tm);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buffer;
+}
+
+bool parse_http_date(const std::string& str, time_t& t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0')
+        return false;
+    t = timegm(&tm);
+    return t != static_cast<time_t>(-1);
+}
+
+void set_close_on_exec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags != -1)
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+}
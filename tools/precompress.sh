@@ -0,0 +1,30 @@
+#!/bin/sh
+# precompress.sh
+# Writes file.gz (and file.br when brotli is installed) next to every text
+# asset of a directory tree, for locations with "precompressed on;".
+# Sidecars already newer than their original are left untouched.
+
+DIR=${1:-www}
+EXTENSIONS="html css js json txt svg xml"
+
+if [ ! -d "$DIR" ]; then
+    echo "Usage: $0 [directory]" >&2
+    exit 1
+fi
+
+HAS_BROTLI=0
+command -v brotli > /dev/null 2>&1 && HAS_BROTLI=1
+[ $HAS_BROTLI -eq 0 ] && echo "brotli not found, only .gz sidecars are generated"
+
+for ext in $EXTENSIONS; do
+    find "$DIR" -type f -name "*.$ext" | while IFS= read -r file; do
+        if [ ! "$file.gz" -nt "$file" ]; then
+            echo "  $file.gz"
+            gzip -9 -n -c "$file" > "$file.gz"
+        fi
+        if [ $HAS_BROTLI -eq 1 ] && [ ! "$file.br" -nt "$file" ]; then
+            echo "  $file.br"
+            brotli -q 11 -c "$file" > "$file.br"
+        fi
+    done
+done